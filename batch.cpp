@@ -0,0 +1,192 @@
+/*
+  batch.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QElapsedTimer>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "batch.h"
+#include "batchutil.h"
+#include "stlfile.h"
+
+/*!
+  Loads one file and formats its statistics as a JSON object
+*/
+static BatchResult fileStats(const QString &fname) {
+    BatchResult result;
+    std::string &json = result.json;
+    json = "    {\"file\": " + jsonString(fname);
+    char buf[1024];
+    try {
+        QElapsedTimer timer;
+        timer.start();
+        STLFile stlf(QFile::encodeName(fname).constData());
+        double parseSeconds = timer.nsecsElapsed()*1.0e-9;
+
+        timer.restart();
+        float min[3], max[3], center[3], centroid[3];
+        stlf.getBounds(min, max);
+        stlf.getCenter(center);
+        stlf.getCentroid(centroid);
+        double area = stlf.getSurfaceArea();
+        double volume = stlf.getVolume();
+        std::vector<unsigned char> flags;
+        NormalCheckCounts bad = stlf.checkNormals(flags);
+        double statsSeconds = timer.nsecsElapsed()*1.0e-9;
+
+        std::sprintf(buf, ", \"bytes\": %lld, \"triangles\": %lu,"
+                     " \"bounds\": {\"min\": [%.9g, %.9g, %.9g], \"max\": [%.9g, %.9g, %.9g]},"
+                     " \"bounding_sphere\": {\"center\": [%.9g, %.9g, %.9g], \"radius\": %.9g},"
+                     " \"centroid\": [%.9g, %.9g, %.9g], \"surface_area\": %.17g, \"volume\": %.17g,"
+                     " \"flipped_normals\": %lu, \"degenerate_facets\": %lu, \"unset_normals\": %lu,"
+                     " \"parse_seconds\": %.6f, \"stats_seconds\": %.6f}",
+                     (long long)QFileInfo(fname).size(), (unsigned long)stlf.getNumTris(),
+                     min[0], min[1], min[2], max[0], max[1], max[2],
+                     center[0], center[1], center[2], stlf.getBoundingRadius(),
+                     centroid[0], centroid[1], centroid[2], area, volume,
+                     (unsigned long)bad.flipped, (unsigned long)bad.degenerate, (unsigned long)bad.unset,
+                     parseSeconds, statsSeconds);
+        json += buf;
+        result.ok = true;
+    } catch (std::runtime_error &re) {
+        json += ", \"error\": " + jsonString(QString(re.what())) + "}";
+    } catch (std::bad_alloc &) {
+        json += ", \"error\": \"out of memory\"}";
+    }
+    return result;
+}
+
+/*!
+  Reads one STL file and writes it back out in the other format, with the
+  time taken by each step as JSON
+*/
+int runConvert(int argc, char *argv[]) {
+    bool binary = true;
+    bool repair = false;
+    int threads = 0;
+    QStringList args;
+    for (int i=0; i<argc; ++i) {
+        if (0 == std::strcmp(argv[i], "-a")) {
+            binary = false;
+        } else if (0 == std::strcmp(argv[i], "--repair")) {
+            repair = true;
+        } else if (0 == std::strcmp(argv[i], "-j") && i+1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else {
+            args << QFile::decodeName(argv[i]);
+        }
+    }
+    if (args.size() != 2) {
+        std::fprintf(stderr, "Usage: stlviewer --convert [-a] [--repair] [-j threads] input.stl output.stl\n");
+        return 1;
+    }
+#ifdef _OPENMP
+    if (threads > 0) {
+        omp_set_num_threads(threads);
+    }
+#endif
+
+    try {
+        QElapsedTimer timer;
+        timer.start();
+        STLFile stlf(QFile::encodeName(args[0]).constData());
+        double parseSeconds = timer.nsecsElapsed()*1.0e-9;
+
+        timer.restart();
+        unsigned long rewound = 0;
+        if (repair) {
+            rewound = (unsigned long)stlf.repairNormals().rewound;
+        }
+        double repairSeconds = timer.nsecsElapsed()*1.0e-9;
+
+        timer.restart();
+        stlf.save(QFile::encodeName(args[1]).constData(), binary);
+        double writeSeconds = timer.nsecsElapsed()*1.0e-9;
+
+        std::printf("{\"input\": %s, \"output\": %s, \"format\": \"%s\", \"triangles\": %lu,"
+                    " \"rewound\": %lu, \"bytes\": %lld, \"parse_seconds\": %.6f,"
+                    " \"repair_seconds\": %.6f, \"write_seconds\": %.6f}\n",
+                    jsonString(args[0]).c_str(), jsonString(args[1]).c_str(),
+                    binary ? "binary" : "ascii", (unsigned long)stlf.getNumTris(), rewound,
+                    (long long)QFileInfo(args[1]).size(), parseSeconds, repairSeconds, writeSeconds);
+    } catch (std::runtime_error &re) {
+        std::fprintf(stderr, "%s\n", re.what());
+        return 2;
+    } catch (std::bad_alloc &) {
+        std::fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    return 0;
+}
+
+int runStats(int argc, char *argv[]) {
+    QStringList args;
+    int threads = 0;
+    for (int i=0; i<argc; ++i) {
+        if (0 == std::strcmp(argv[i], "-j") && i+1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else {
+            args << QFile::decodeName(argv[i]);
+        }
+    }
+    QStringList files = collectFiles(args);
+    if (files.isEmpty()) {
+        std::fprintf(stderr, "Usage: stlviewer --stats [-j threads] file-or-directory...\n");
+        return 1;
+    }
+
+#ifdef _OPENMP
+    if (threads > 0) {
+        omp_set_num_threads(threads);
+    }
+    threads = omp_get_max_threads();
+#else
+    threads = 1;
+#endif
+
+    // Files are spread across the cores, each file is loaded on one of them
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<BatchResult> results(files.size());
+    bool failed = false;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long i=0; i<long(files.size()); ++i) {
+        results[i] = fileStats(files.at(int(i)));
+    }
+    double totalSeconds = timer.nsecsElapsed()*1.0e-9;
+
+    std::printf("{\n  \"threads\": %d,\n  \"total_seconds\": %.6f,\n  \"files\": [\n", threads, totalSeconds);
+    for (size_t i=0; i<results.size(); ++i) {
+        failed = failed || !results[i].ok;
+        std::printf("%s%s\n", results[i].json.c_str(), (i+1 < results.size()) ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+    return failed ? 2 : 0;
+}
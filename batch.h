@@ -0,0 +1,36 @@
+/*
+  batch.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef BATCH_HEADER
+#define BATCH_HEADER
+
+/*!
+  Headless entry points that don't need a display or OpenGL.
+  Each takes the command line arguments after the mode flag and returns
+  the process exit code.
+*/
+
+// stlviewer --stats [-j threads] file-or-directory...
+// Prints mesh statistics and parse timings as JSON
+int runStats(int argc, char *argv[]);
+
+// stlviewer --convert [-a] [--repair] [-j threads] input.stl output.stl
+// Writes input as a binary STL file, or ASCII with -a, repairing the normals first with --repair
+int runConvert(int argc, char *argv[]);
+
+#endif
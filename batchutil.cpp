@@ -0,0 +1,81 @@
+/*
+  batchutil.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+
+#include <cstdio>
+
+#include "batchutil.h"
+#include "fastfloat.h"
+
+QStringList collectFiles(const QStringList &args, QStringList *relative) {
+    QStringList files;
+    for (int i=0; i<args.size(); ++i) {
+        QFileInfo info(args[i]);
+        if (info.isDir()) {
+            QStringList found;
+            QDirIterator it(args[i], QStringList() << "*.stl" << "*.STL",
+                            QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                found << it.next();
+            }
+            found.sort();
+            files << found;
+            if (relative) {
+                QDir root(args[i]);
+                for (int j=0; j<found.size(); ++j) {
+                    *relative << root.relativeFilePath(found[j]);
+                }
+            }
+        } else {
+            files << args[i];
+            if (relative) {
+                *relative << info.fileName();
+            }
+        }
+    }
+    return files;
+}
+
+std::string jsonString(const QString &str) {
+    QByteArray utf8 = str.toUtf8();
+    std::string out = "\"";
+    for (int i=0; i<utf8.size(); ++i) {
+        unsigned char c = (unsigned char)utf8[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        } else if (c < 0x20) {
+            char buf[8];
+            std::sprintf(buf, "\\u%04x", c);
+            out += buf;
+        } else {
+            out += char(c);
+        }
+    }
+    return out + "\"";
+}
+
+std::string jsonNumber(double value, const char *format) {
+    // Room for any double, even with %f
+    char buf[512];
+    int len = format_float(buf, format, value);
+    return std::string(buf, len > 0 ? len : 0);
+}
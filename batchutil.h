@@ -0,0 +1,63 @@
+/*
+  batchutil.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef BATCH_UTIL_HEADER
+#define BATCH_UTIL_HEADER
+
+#include <QString>
+#include <QStringList>
+
+#include <string>
+
+/*!
+  Helpers shared by the headless batch modes, which all take files and
+  directories on the command line and report one JSON object per file
+*/
+
+/*!
+  One file's entry in a batch report
+*/
+struct BatchResult {
+    BatchResult() : ok(false) {}
+
+    // The JSON object for the "files" array, indented to match
+    std::string json;
+    // False if the file failed, in which case json has an "error" field
+    bool ok;
+};
+
+/*!
+  Expands the arguments into a list of files.  Directories are searched
+  recursively for .stl files, and what's found in each is sorted by path.
+  If relative is given it gets each file's path relative to the directory
+  it was found under, or just the file name for files given directly.
+*/
+QStringList collectFiles(const QStringList &args, QStringList *relative = 0);
+
+/*!
+  Quotes and escapes str as a JSON string, encoded as UTF-8
+*/
+std::string jsonString(const QString &str);
+
+/*!
+  Formats value for JSON with a printf conversion like "%.6f".  The
+  decimal point is always '.', even after QApplication sets the locale.
+*/
+std::string jsonNumber(double value, const char *format);
+
+#endif
@@ -0,0 +1,12 @@
+######################################################################
+# Benchmarks for the STL reader.  Not built with the viewer.
+######################################################################
+
+TEMPLATE = subdirs
+
+parsebench.file = parsebench.pro
+floatbench.file = floatbench.pro
+genstl.file = genstl.pro
+loadbench.file = loadbench.pro
+
+SUBDIRS += parsebench floatbench genstl loadbench
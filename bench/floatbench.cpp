@@ -0,0 +1,118 @@
+/*
+  floatbench.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+#include "fastfloat.h"
+#include "mappedfile.h"
+#include "benchtimer.h"
+
+/*!
+  Collects every numeric token in an ASCII STL file
+*/
+static void collect_numbers(const char *data, size_t size, std::vector<std::string> &numbers) {
+    const char *end = data + size;
+    const char *p = data;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+        const char *tb = p;
+        while (p < end && !(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+        if (tb < p && (std::strchr("+-.0123456789", *tb) != 0)) {
+            numbers.push_back(std::string(tb, p));
+        }
+    }
+}
+
+/*!
+  Times parse_float against the strtod baseline on the numbers from an
+  ASCII STL file, repeated until there are at least count of them, and
+  checks that both give the same floats.
+
+  Usage: floatbench [-n count] file.stl
+*/
+int main(int argc, char *argv[]) {
+    size_t count = 10000000;
+    int first = 1;
+    if (argc > 2 && 0 == std::strcmp(argv[1], "-n")) {
+        count = size_t(std::atol(argv[2]));
+        first = 3;
+    }
+    if (first >= argc) {
+        std::fprintf(stderr, "Usage: %s [-n count] file.stl\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> numbers;
+    try {
+        MappedFile mf(argv[first]);
+        collect_numbers(mf.data(), mf.size(), numbers);
+    } catch (std::runtime_error &re) {
+        std::fprintf(stderr, "%s: %s\n", argv[first], re.what());
+        return 1;
+    }
+    if (numbers.empty()) {
+        std::fprintf(stderr, "%s: no numbers found\n", argv[first]);
+        return 1;
+    }
+
+    // Lay the numbers out back to back like they'd be in a big file
+    std::string text;
+    std::vector<size_t> offsets;
+    for (size_t i=0; i<count; ++i) {
+        offsets.push_back(text.size());
+        text += numbers[i % numbers.size()];
+        text += ' ';
+    }
+    offsets.push_back(text.size());
+    double mbytes = double(text.size())/(1024.0*1024.0);
+
+    std::vector<float> baseline(count);
+    std::vector<float> fast(count);
+
+    double start = wallTime();
+    for (size_t i=0; i<count; ++i) {
+        baseline[i] = float(std::strtod(text.c_str() + offsets[i], 0));
+    }
+    double strtod_time = wallTime() - start;
+
+    start = wallTime();
+    for (size_t i=0; i<count; ++i) {
+        parse_float(text.c_str() + offsets[i], text.c_str() + offsets[i+1] - 1, fast[i]);
+    }
+    double fast_time = wallTime() - start;
+
+    size_t mismatches = 0;
+    for (size_t i=0; i<count; ++i) {
+        if (0 != std::memcmp(&baseline[i], &fast[i], sizeof(float))) {
+            ++mismatches;
+        }
+    }
+
+    std::printf("%lu numbers, %.1f MB\n", (unsigned long)count, mbytes);
+    std::printf("%-12s %10s %10s\n", "parser", "seconds", "MB/s");
+    std::printf("%-12s %10.4f %10.1f\n", "strtod", strtod_time, mbytes/strtod_time);
+    std::printf("%-12s %10.4f %10.1f\n", "parse_float", fast_time, mbytes/fast_time);
+    std::printf("speedup %.2fx, %lu results differ from strtod\n",
+                strtod_time/fast_time, (unsigned long)mismatches);
+    return 0;
+}
@@ -0,0 +1,14 @@
+######################################################################
+# Float parsing microbenchmark: parse_float against strtod.
+######################################################################
+
+TEMPLATE = app
+TARGET = floatbench
+CONFIG += console
+CONFIG -= qt app_bundle
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+
+# Input
+HEADERS += benchtimer.h ../fastfloat.h ../mappedfile.h
+SOURCES += floatbench.cpp ../fastfloat.cpp ../mappedfile.cpp
@@ -0,0 +1,57 @@
+/*
+  genstl.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "meshgen.h"
+
+/*!
+  Writes a synthetic STL file for the benchmarks.
+
+  Usage: genstl [-a] [-s seed] triangles out.stl
+  Sizes may use K and M suffixes, e.g. 50M.  -a writes ASCII.
+*/
+int main(int argc, char *argv[]) {
+    bool binary = true;
+    unsigned int seed = 1;
+    int i = 1;
+    for (; i<argc && argv[i][0] == '-'; ++i) {
+        if (0 == std::strcmp(argv[i], "-a")) {
+            binary = false;
+        } else if (0 == std::strcmp(argv[i], "-s") && i+1 < argc) {
+            seed = unsigned(std::atol(argv[++i]));
+        } else {
+            break;
+        }
+    }
+    size_t num_tris = (i+2 == argc) ? parseTriangleCount(argv[i]) : 0;
+    if (num_tris == 0) {
+        std::fprintf(stderr, "Usage: %s [-a] [-s seed] triangles out.stl\n", argv[0]);
+        return 1;
+    }
+    try {
+        writeSyntheticSTL(argv[i+1], num_tris, binary, seed);
+    } catch (std::runtime_error &re) {
+        std::fprintf(stderr, "%s\n", re.what());
+        return 1;
+    }
+    return 0;
+}
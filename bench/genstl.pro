@@ -0,0 +1,22 @@
+######################################################################
+# Synthetic STL generator for the benchmarks.
+######################################################################
+
+TEMPLATE = app
+TARGET = genstl
+CONFIG += console
+CONFIG -= qt app_bundle
+DEPENDPATH += .
+INCLUDEPATH += .
+
+linux*|win32-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += -openmp
+}
+
+# Input
+HEADERS += meshgen.h
+SOURCES += genstl.cpp meshgen.cpp
@@ -0,0 +1,390 @@
+/*
+  loadbench.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtOpenGL>
+#include <QGLPixelBuffer>
+#include <QGLBuffer>
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "stlfile.h"
+#include "meshgen.h"
+#include "benchtimer.h"
+
+// Offscreen render target size
+static const int FRAME_WIDTH = 800;
+static const int FRAME_HEIGHT = 600;
+
+/*!
+  Settings for one run, all of which are echoed in the output so two
+  result files can be checked for being comparable
+*/
+struct BenchConfig {
+    QString dataDir;
+    std::vector<size_t> sizes;
+    int repeats;
+    int frames;
+    unsigned int seed;
+    bool useGL;
+};
+
+/*!
+  Timings for one file.  Negative values mean the step was skipped.
+*/
+struct BenchResult {
+    std::string file;
+    std::string format;
+    size_t triangles;
+    qint64 bytes;
+    double generateSeconds;
+    double parseSeconds;
+    double weldSeconds;
+    double uploadSeconds;
+    double listSeconds;
+    double bufferFrameMs;
+    double listFrameMs;
+};
+
+static std::string jsonNumber(double value, const char *fmt = "%.6f") {
+    if (value < 0.0) {
+        return "null";
+    }
+    char buf[64];
+    std::sprintf(buf, fmt, value);
+    return buf;
+}
+
+static std::string jsonString(const std::string &str) {
+    std::string out = "\"";
+    for (size_t i=0; i<str.size(); ++i) {
+        if (str[i] == '"' || str[i] == '\\') {
+            out += '\\';
+        }
+        out += str[i];
+    }
+    return out + "\"";
+}
+
+static std::string glString(GLenum name) {
+    const GLubyte *str = glGetString(name);
+    return str ? std::string((const char*)str) : std::string();
+}
+
+/*!
+  Sets up the same projection, lighting and material as the viewer
+*/
+static void setupScene(float radius) {
+    glViewport(0, 0, FRAME_WIDTH, FRAME_HEIGHT);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(65.0, GLfloat(FRAME_WIDTH)/GLfloat(FRAME_HEIGHT), 0.1, 10.0*radius);
+    glMatrixMode(GL_MODELVIEW);
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_NORMALIZE);
+    glShadeModel(GL_SMOOTH);
+
+    GLfloat light_position[4] = {0.0f, 0.0f, 30.0f, 1.0f};
+    GLfloat light_color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    GLfloat mat_diffuse[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_color);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat_diffuse);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+}
+
+/*!
+  Renders frames of the current model and returns the mean milliseconds
+  per frame.  glFinish is included so the GPU work is counted.
+*/
+static double timeFrames(int frames, float radius, const float center[3], QGLBuffer *vertexBuffer,
+                         QGLBuffer *normalBuffer, GLuint list, size_t num_tris) {
+    double start = wallTime();
+    for (int f=0; f<frames; ++f) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glLoadIdentity();
+        glTranslatef(0.0f, 0.0f, -2.0f*radius);
+        glRotatef(360.0f*float(f)/float(frames), 0.3f, 1.0f, 0.1f);
+        glTranslatef(-center[0], -center[1], -center[2]);
+        if (list) {
+            glCallList(list);
+        } else {
+            glEnableClientState(GL_VERTEX_ARRAY);
+            glEnableClientState(GL_NORMAL_ARRAY);
+            vertexBuffer->bind();
+            glVertexPointer(3, GL_FLOAT, 0, 0);
+            normalBuffer->bind();
+            glNormalPointer(GL_FLOAT, 0, 0);
+            glDrawArrays(GL_TRIANGLES, 0, GLsizei(3*num_tris));
+            QGLBuffer::release(QGLBuffer::VertexBuffer);
+            glDisableClientState(GL_NORMAL_ARRAY);
+            glDisableClientState(GL_VERTEX_ARRAY);
+        }
+        glFinish();
+    }
+    return 1000.0*(wallTime() - start)/double(frames);
+}
+
+/*!
+  Times the GL side of displaying stlf: uploading to buffer objects,
+  compiling the display list fallback, and drawing frames with each
+*/
+static void benchGL(const BenchConfig &config, STLFile &stlf, BenchResult &res) {
+    size_t num_tris = stlf.getNumTris();
+    float radius = stlf.getBoundingRadius();
+    float center[3];
+    stlf.getCenter(center);
+    setupScene(radius);
+
+    qint64 vertBytes = qint64(num_tris)*9*qint64(sizeof(float));
+    // QGLBuffer sizes are ints, same limit as the viewer
+    if (vertBytes <= INT_MAX) {
+        QGLBuffer vertexBuffer(QGLBuffer::VertexBuffer);
+        QGLBuffer normalBuffer(QGLBuffer::VertexBuffer);
+        if (vertexBuffer.create() && normalBuffer.create()) {
+            double start = wallTime();
+            vertexBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+            vertexBuffer.bind();
+            vertexBuffer.allocate(stlf.getPositions(), int(vertBytes));
+            normalBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+            normalBuffer.bind();
+            normalBuffer.allocate(stlf.getNormals(), int(vertBytes));
+            QGLBuffer::release(QGLBuffer::VertexBuffer);
+            glFinish();
+            res.uploadSeconds = wallTime() - start;
+
+            // The first frame pays for any deferred driver work, so it isn't counted
+            timeFrames(1, radius, center, &vertexBuffer, &normalBuffer, 0, num_tris);
+            res.bufferFrameMs = timeFrames(config.frames, radius, center, &vertexBuffer, &normalBuffer, 0, num_tris);
+        }
+    }
+
+    GLuint list = glGenLists(1);
+    double start = wallTime();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNewList(list, GL_COMPILE);
+    glVertexPointer(3, GL_FLOAT, 0, stlf.getPositions());
+    glNormalPointer(GL_FLOAT, 0, stlf.getNormals());
+    glDrawArrays(GL_TRIANGLES, 0, GLsizei(3*num_tris));
+    glEndList();
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glFinish();
+    if (glGetError() == GL_NO_ERROR) {
+        res.listSeconds = wallTime() - start;
+        timeFrames(1, radius, center, 0, 0, list, num_tris);
+        res.listFrameMs = timeFrames(config.frames, radius, center, 0, 0, list, num_tris);
+    }
+    glDeleteLists(list, 1);
+}
+
+/*!
+  Generates the file if needed and runs every step on it
+*/
+static BenchResult benchFile(const BenchConfig &config, size_t num_tris, bool binary) {
+    BenchResult res;
+    res.format = binary ? "binary" : "ascii";
+    res.triangles = num_tris;
+    res.generateSeconds = res.parseSeconds = res.weldSeconds = -1.0;
+    res.uploadSeconds = res.listSeconds = res.bufferFrameMs = res.listFrameMs = -1.0;
+
+    QString fname = QDir(config.dataDir).filePath(QString("synthetic-%1-%2-s%3.stl")
+                                                  .arg(num_tris).arg(res.format.c_str()).arg(config.seed));
+    res.file = QFile::encodeName(fname).constData();
+    // The generator is deterministic, so a file from an earlier run can be reused
+    if (!QFileInfo(fname).exists()) {
+        std::fprintf(stderr, "Generating %s\n", res.file.c_str());
+        double start = wallTime();
+        writeSyntheticSTL(res.file, num_tris, binary, config.seed);
+        res.generateSeconds = wallTime() - start;
+    }
+    res.bytes = QFileInfo(fname).size();
+
+    std::fprintf(stderr, "Benchmarking %s\n", res.file.c_str());
+    STLFile *best = 0;
+    for (int r=0; r<config.repeats; ++r) {
+        double start = wallTime();
+        STLFile *stlf = new STLFile(res.file);
+        double elapsed = wallTime() - start;
+        if (r == 0 || elapsed < res.parseSeconds) {
+            res.parseSeconds = elapsed;
+        }
+        delete best;
+        best = stlf;
+    }
+    if (best->getNumTris() != num_tris) {
+        delete best;
+        throw std::runtime_error(res.file + ": wrong triangle count");
+    }
+
+    {
+        std::vector<float> verts, norms;
+        std::vector<unsigned int> indices;
+        double start = wallTime();
+        best->buildIndexedMesh(1.0e-6f*best->getBoundingRadius(), verts, norms, indices);
+        res.weldSeconds = wallTime() - start;
+    }
+
+    if (config.useGL) {
+        benchGL(config, *best, res);
+    }
+    delete best;
+    return res;
+}
+
+static void printResults(const BenchConfig &config, const std::vector<BenchResult> &results,
+                         const std::string &vendor, const std::string &renderer,
+                         const std::string &version) {
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+#if defined(__VERSION__)
+    std::string compiler = __VERSION__;
+#elif defined(_MSC_VER)
+    std::string compiler = "MSVC " + QString::number(_MSC_VER).toStdString();
+#else
+    std::string compiler = "unknown";
+#endif
+
+    std::printf("{\n  \"config\": {\"seed\": %u, \"repeats\": %d, \"frames\": %d,"
+                " \"frame_size\": [%d, %d], \"threads\": %d},\n",
+                config.seed, config.repeats, config.frames, FRAME_WIDTH, FRAME_HEIGHT, threads);
+    std::printf("  \"build\": {\"compiler\": %s, \"qt\": %s, \"gl_vendor\": %s,"
+                " \"gl_renderer\": %s, \"gl_version\": %s},\n",
+                jsonString(compiler).c_str(), jsonString(qVersion()).c_str(),
+                jsonString(vendor).c_str(), jsonString(renderer).c_str(), jsonString(version).c_str());
+    std::printf("  \"results\": [\n");
+    for (size_t i=0; i<results.size(); ++i) {
+        const BenchResult &res = results[i];
+        std::printf("    {\"file\": %s, \"format\": \"%s\", \"triangles\": %lu, \"bytes\": %lld,"
+                    " \"generate_seconds\": %s, \"parse_seconds\": %s, \"parse_mb_per_second\": %s,"
+                    " \"weld_seconds\": %s, \"upload_seconds\": %s, \"list_compile_seconds\": %s,"
+                    " \"buffer_frame_ms\": %s, \"list_frame_ms\": %s}%s\n",
+                    jsonString(res.file).c_str(), res.format.c_str(),
+                    (unsigned long)res.triangles, (long long)res.bytes,
+                    jsonNumber(res.generateSeconds).c_str(), jsonNumber(res.parseSeconds).c_str(),
+                    jsonNumber(res.parseSeconds > 0.0 ? double(res.bytes)/(1024.0*1024.0)/res.parseSeconds : -1.0, "%.1f").c_str(),
+                    jsonNumber(res.weldSeconds).c_str(), jsonNumber(res.uploadSeconds).c_str(),
+                    jsonNumber(res.listSeconds).c_str(), jsonNumber(res.bufferFrameMs, "%.3f").c_str(),
+                    jsonNumber(res.listFrameMs, "%.3f").c_str(), (i+1 < results.size()) ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+}
+
+/*!
+  Generates binary and ASCII files of each size, then times parsing,
+  welding, buffer upload, display list compilation and frame rendering
+  into an offscreen pbuffer.  Results are printed as JSON on stdout and
+  progress goes to stderr.
+
+  On a machine without a display run it under xvfb-run to get Mesa's
+  software renderer, or pass --no-gl to time only the CPU side.
+
+  Usage: loadbench [-d dir] [-r repeats] [-f frames] [-s seed] [--no-gl] [sizes...]
+  Sizes take K and M suffixes and default to 1K 10K 100K 1M 10M.
+*/
+int main(int argc, char *argv[]) {
+    BenchConfig config;
+    config.dataDir = QDir::tempPath();
+    config.repeats = 3;
+    config.frames = 20;
+    config.seed = 1;
+    config.useGL = true;
+
+    for (int i=1; i<argc; ++i) {
+        if (0 == std::strcmp(argv[i], "-d") && i+1 < argc) {
+            config.dataDir = QFile::decodeName(argv[++i]);
+        } else if (0 == std::strcmp(argv[i], "-r") && i+1 < argc) {
+            config.repeats = std::atoi(argv[++i]);
+        } else if (0 == std::strcmp(argv[i], "-f") && i+1 < argc) {
+            config.frames = std::atoi(argv[++i]);
+        } else if (0 == std::strcmp(argv[i], "-s") && i+1 < argc) {
+            config.seed = unsigned(std::atol(argv[++i]));
+        } else if (0 == std::strcmp(argv[i], "--no-gl")) {
+            config.useGL = false;
+        } else {
+            size_t num_tris = parseTriangleCount(argv[i]);
+            if (num_tris == 0) {
+                config.sizes.clear();
+                config.repeats = 0;
+                break;
+            }
+            config.sizes.push_back(num_tris);
+        }
+    }
+    if (config.repeats < 1 || config.frames < 1) {
+        std::fprintf(stderr, "Usage: %s [-d dir] [-r repeats] [-f frames] [-s seed] [--no-gl] [sizes...]\n", argv[0]);
+        return 1;
+    }
+    if (config.sizes.empty()) {
+        const size_t defaults[] = {1000, 10000, 100000, 1000000, 10000000};
+        config.sizes.assign(defaults, defaults + sizeof(defaults)/sizeof(defaults[0]));
+    }
+
+    QApplication app(argc, argv, config.useGL);
+
+    QGLPixelBuffer *pbuffer = 0;
+    std::string vendor, renderer, version;
+    if (config.useGL) {
+        if (!QGLPixelBuffer::hasOpenGLPbuffers()) {
+            std::fprintf(stderr, "No OpenGL pbuffer support, only timing the CPU side\n");
+            config.useGL = false;
+        } else {
+            pbuffer = new QGLPixelBuffer(QSize(FRAME_WIDTH, FRAME_HEIGHT),
+                                         QGLFormat(QGL::DepthBuffer));
+            pbuffer->makeCurrent();
+            vendor = glString(GL_VENDOR);
+            renderer = glString(GL_RENDERER);
+            version = glString(GL_VERSION);
+        }
+    }
+
+    std::vector<BenchResult> results;
+    try {
+        for (size_t i=0; i<config.sizes.size(); ++i) {
+            results.push_back(benchFile(config, config.sizes[i], true));
+            results.push_back(benchFile(config, config.sizes[i], false));
+        }
+    } catch (std::runtime_error &re) {
+        std::fprintf(stderr, "%s\n", re.what());
+        delete pbuffer;
+        return 1;
+    }
+
+    printResults(config, results, vendor, renderer, version);
+    delete pbuffer;
+    return 0;
+}
@@ -0,0 +1,24 @@
+######################################################################
+# End to end benchmark on synthetic files: parse, weld, GPU upload and
+# frame rendering into an offscreen pbuffer.
+######################################################################
+
+TEMPLATE = app
+TARGET = loadbench
+CONFIG += console
+CONFIG -= app_bundle
+QT += opengl
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+
+linux*|win32-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += -openmp
+}
+
+# Input
+HEADERS += benchtimer.h meshgen.h ../fastfloat.h ../mappedfile.h ../stlfile.h
+SOURCES += loadbench.cpp meshgen.cpp ../fastfloat.cpp ../mappedfile.cpp ../stlfile.cpp
@@ -0,0 +1,189 @@
+/*
+  meshgen.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+#include "meshgen.h"
+
+// Triangles generated per block, blocks are formatted in parallel
+static const size_t GEN_BLOCK_TRIS = 1<<16;
+
+/*!
+  Layout of the latitude/longitude grid holding num_tris triangles.
+  The last row is only partly filled and an odd count drops the second
+  half of the last quad.
+*/
+struct SphereGrid {
+    size_t cols;
+    size_t rows;
+    unsigned int seed;
+
+    SphereGrid(size_t num_tris, unsigned int sd) : seed(sd) {
+        size_t quads = (num_tris+1)/2;
+        cols = size_t(std::ceil(std::sqrt(2.0*double(quads))));
+        if (cols < 3) {
+            cols = 3;
+        }
+        rows = (quads + cols - 1)/cols;
+    }
+
+    // Position of grid vertex (r, c), bumped by a hash so the file isn't trivially compressible
+    void vertex(size_t r, size_t c, float pt[3]) const {
+        unsigned int h = unsigned(r)*73856093u ^ unsigned(c % cols)*19349663u ^ seed*83492791u;
+        h ^= h >> 13;
+        h *= 0x5bd1e995u;
+        h ^= h >> 15;
+        double radius = 100.0 + 0.5*double(h & 0xffff)/65535.0;
+        double theta = M_PI*double(r)/double(rows);
+        double phi = 2.0*M_PI*double(c % cols)/double(cols);
+        pt[0] = float(radius*std::sin(theta)*std::cos(phi));
+        pt[1] = float(radius*std::sin(theta)*std::sin(phi));
+        pt[2] = float(radius*std::cos(theta));
+    }
+
+    // Corners of triangle t in counter-clockwise order and its unit normal
+    void triangle(size_t t, float norm[3], float pts[9]) const {
+        size_t q = t/2;
+        size_t r = q/cols;
+        size_t c = q%cols;
+        if (t%2 == 0) {
+            vertex(r, c, pts);
+            vertex(r+1, c, pts+3);
+            vertex(r+1, c+1, pts+6);
+        } else {
+            vertex(r, c, pts);
+            vertex(r+1, c+1, pts+3);
+            vertex(r, c+1, pts+6);
+        }
+        float u[3] = {pts[3]-pts[0], pts[4]-pts[1], pts[5]-pts[2]};
+        float v[3] = {pts[6]-pts[0], pts[7]-pts[1], pts[8]-pts[2]};
+        norm[0] = u[1]*v[2] - u[2]*v[1];
+        norm[1] = u[2]*v[0] - u[0]*v[2];
+        norm[2] = u[0]*v[1] - u[1]*v[0];
+        float len = std::sqrt(norm[0]*norm[0] + norm[1]*norm[1] + norm[2]*norm[2]);
+        if (len > 0.0f) {
+            norm[0] /= len;
+            norm[1] /= len;
+            norm[2] /= len;
+        }
+    }
+};
+
+static void format_binary(const SphereGrid &grid, size_t first, size_t count, std::string &out) {
+    out.resize(count*50);
+    char *p = &out[0];
+    for (size_t t=first; t<first+count; ++t) {
+        float tri[12];
+        grid.triangle(t, tri, tri+3);
+        std::memcpy(p, tri, 48);
+        p[48] = p[49] = 0;
+        p += 50;
+    }
+}
+
+static void format_ascii(const SphereGrid &grid, size_t first, size_t count, std::string &out) {
+    out.clear();
+    out.reserve(count*260);
+    char buf[512];
+    for (size_t t=first; t<first+count; ++t) {
+        float n[3], v[9];
+        grid.triangle(t, n, v);
+        int len = std::sprintf(buf, "  facet normal %e %e %e\n    outer loop\n"
+                               "      vertex %e %e %e\n      vertex %e %e %e\n      vertex %e %e %e\n"
+                               "    endloop\n  endfacet\n",
+                               n[0], n[1], n[2], v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]);
+        out.append(buf, len);
+    }
+}
+
+void writeSyntheticSTL(const std::string &fname, size_t num_tris, bool binary, unsigned int seed) {
+    FILE *outf = std::fopen(fname.c_str(), "wb");
+    if (!outf) {
+        throw std::runtime_error("Could not create " + fname);
+    }
+    SphereGrid grid(num_tris, seed);
+
+    bool ok = true;
+    if (binary) {
+        char header[84];
+        std::memset(header, 0, sizeof(header));
+        std::snprintf(header, 80, "synthetic %lu triangles seed %u",
+                      (unsigned long)num_tris, seed);
+        unsigned int count = (unsigned int)num_tris;
+        std::memcpy(header+80, &count, 4);
+        ok = std::fwrite(header, 1, sizeof(header), outf) == sizeof(header);
+    } else {
+        ok = std::fprintf(outf, "solid synthetic\n") > 0;
+    }
+
+    // A round of blocks is formatted in parallel and then written in order
+    size_t num_blocks = (num_tris + GEN_BLOCK_TRIS - 1)/GEN_BLOCK_TRIS;
+    const long ROUND_BLOCKS = 64;
+    std::vector<std::string> blocks(ROUND_BLOCKS);
+    for (size_t round=0; ok && round<num_blocks; round += ROUND_BLOCKS) {
+        long in_round = long(std::min(size_t(ROUND_BLOCKS), num_blocks - round));
+#pragma omp parallel for schedule(dynamic, 1)
+        for (long b=0; b<in_round; ++b) {
+            size_t first = (round + size_t(b))*GEN_BLOCK_TRIS;
+            size_t count = std::min(GEN_BLOCK_TRIS, num_tris - first);
+            if (binary) {
+                format_binary(grid, first, count, blocks[b]);
+            } else {
+                format_ascii(grid, first, count, blocks[b]);
+            }
+        }
+        for (long b=0; ok && b<in_round; ++b) {
+            ok = std::fwrite(blocks[b].data(), 1, blocks[b].size(), outf) == blocks[b].size();
+        }
+    }
+
+    if (ok && !binary) {
+        ok = std::fprintf(outf, "endsolid synthetic\n") > 0;
+    }
+    if (std::fclose(outf) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        throw std::runtime_error("Error writing " + fname);
+    }
+}
+
+size_t parseTriangleCount(const char *str) {
+    char *end = 0;
+    double value = std::strtod(str, &end);
+    if (end == str || value <= 0.0) {
+        return 0;
+    }
+    if (*end == 'k' || *end == 'K') {
+        value *= 1.0e3;
+        ++end;
+    } else if (*end == 'm' || *end == 'M') {
+        value *= 1.0e6;
+        ++end;
+    }
+    if (*end != '\0') {
+        return 0;
+    }
+    return size_t(value + 0.5);
+}
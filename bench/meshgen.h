@@ -0,0 +1,38 @@
+/*
+  meshgen.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef MESH_GEN_HEADER
+#define MESH_GEN_HEADER
+
+#include <string>
+#include <cstddef>
+
+/*!
+  Writes a synthetic closed-ish mesh with exactly num_tris triangles.
+  The surface is a latitude/longitude sphere with bumps from a hash of
+  each grid vertex, so neighbouring triangles share corners exactly and
+  the same size and seed always give byte for byte the same file.
+  Throws std::runtime_error if the file can't be written.
+*/
+void writeSyntheticSTL(const std::string &fname, size_t num_tris, bool binary,
+                       unsigned int seed = 1);
+
+// Parses sizes like 1000, 10K, 2.5M into a triangle count, 0 if invalid
+size_t parseTriangleCount(const char *str);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+  parsebench.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "stlfile.h"
+#include "mappedfile.h"
+#include "benchtimer.h"
+
+/*!
+  Loads each file on the command line several times and prints the best
+  load time and the resulting throughput in MB/s.
+
+  Usage: parsebench [-r repeats] file.stl...
+*/
+int main(int argc, char *argv[]) {
+    int repeats = 5;
+    int first = 1;
+    if (argc > 2 && 0 == std::strcmp(argv[1], "-r")) {
+        repeats = std::atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || repeats < 1) {
+        std::fprintf(stderr, "Usage: %s [-r repeats] file.stl...\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%-40s %12s %12s %10s %10s\n", "file", "bytes", "triangles", "seconds", "MB/s");
+    for (int i=first; i<argc; ++i) {
+        try {
+            size_t bytes = MappedFile(argv[i]).size();
+            size_t num_tris = 0;
+            double best = 0.0;
+            for (int r=0; r<repeats; ++r) {
+                double start = wallTime();
+                STLFile stlf(argv[i]);
+                double elapsed = wallTime() - start;
+                num_tris = stlf.getNumTris();
+                if (r == 0 || elapsed < best) {
+                    best = elapsed;
+                }
+            }
+            std::printf("%-40s %12lu %12lu %10.4f %10.1f\n", argv[i],
+                        (unsigned long)bytes, (unsigned long)num_tris, best,
+                        best > 0.0 ? double(bytes)/(1024.0*1024.0)/best : 0.0);
+        } catch (std::runtime_error &re) {
+            std::fprintf(stderr, "%s: %s\n", argv[i], re.what());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+######################################################################
+# Load throughput benchmark for the STL reader.
+######################################################################
+
+TEMPLATE = app
+TARGET = parsebench
+CONFIG += console
+CONFIG -= qt app_bundle
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+
+linux*|win32-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += -openmp
+}
+
+# Input
+HEADERS += benchtimer.h ../fastfloat.h ../mappedfile.h ../stlfile.h
+SOURCES += parsebench.cpp ../fastfloat.cpp ../mappedfile.cpp ../stlfile.cpp
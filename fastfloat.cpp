@@ -0,0 +1,232 @@
+/*
+  fastfloat.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "fastfloat.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <clocale>
+#include <cfloat>
+
+#include <stdint.h>
+
+// Powers of ten that are exactly representable as floats and doubles
+static const float FLOAT_POW10[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+static const double DOUBLE_POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// At most 19 decimal digits always fit in a uint64_t
+static const int MAX_DIGITS = 19;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define FAST_FLOAT_NO_SWAR
+#endif
+
+#ifndef FAST_FLOAT_NO_SWAR
+/*!
+  True if all 8 bytes of v are ASCII digits
+*/
+static inline bool is_eight_digits(uint64_t v) {
+    return 0 == (((v + 0x4646464646464646ULL) | (v - 0x3030303030303030ULL)) & 0x8080808080808080ULL);
+}
+
+/*!
+  Converts 8 ASCII digits (first digit in the lowest byte) to their value
+  with three multiplies instead of eight multiply/adds.
+*/
+static inline uint32_t parse_eight_digits(uint64_t v) {
+    const uint64_t mask = 0x000000FF000000FFULL;
+    const uint64_t mul1 = 100 + (1000000ULL << 32);
+    const uint64_t mul2 = 1 + (10000ULL << 32);
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+    return uint32_t(v);
+}
+#endif
+
+/*!
+  Accumulates a run of digits into mant.
+  Digits past MAX_DIGITS are dropped, and *truncated is set if any of them are non-zero.
+  Returns the number of digits consumed into mant and advances p past the run.
+*/
+static inline int scan_digits(const char *&p, const char *end, uint64_t &mant,
+                              int &num_digits, bool &truncated, int &dropped) {
+    const char *start = p;
+#ifndef FAST_FLOAT_NO_SWAR
+    while (end - p >= 8 && num_digits + 8 <= MAX_DIGITS) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        if (!is_eight_digits(v)) {
+            break;
+        }
+        mant = mant*100000000ULL + parse_eight_digits(v);
+        num_digits += 8;
+        p += 8;
+    }
+#endif
+    int consumed = int(p - start);
+    while (p < end && unsigned(*p - '0') < 10) {
+        if (num_digits < MAX_DIGITS) {
+            mant = mant*10 + unsigned(*p - '0');
+            ++num_digits;
+            ++consumed;
+        } else {
+            truncated |= (*p != '0');
+            ++dropped;
+        }
+        ++p;
+    }
+    return consumed;
+}
+
+/*!
+  Handles the rare numbers the fast path can't round correctly.
+*/
+static bool parse_float_slow(const char *begin, const char *end, float &out) {
+    char buffer[128];
+    size_t len = size_t(end - begin);
+    if (len >= sizeof(buffer)) {
+        return false;
+    }
+    std::memcpy(buffer, begin, len);
+    buffer[len] = '\0';
+
+    // strtod follows the locale, so swap in whatever decimal point it expects
+    char point = std::localeconv()->decimal_point[0];
+    if (point != '.') {
+        char *dot = std::strchr(buffer, '.');
+        if (dot) {
+            *dot = point;
+        }
+    }
+
+    char *nend;
+#if defined(_MSC_VER) && _MSC_VER < 1800
+    // Older msvc++ doesn't have strtof
+    out = float(std::strtod(buffer, &nend));
+#else
+    out = std::strtof(buffer, &nend);
+#endif
+    return nend == buffer + len;
+}
+
+bool parse_float(const char *begin, const char *end, float &out) {
+    const char *p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    uint64_t mant = 0;
+    int num_digits = 0;
+    int dropped = 0;
+    bool truncated = false;
+
+    // Dropped integer digits scale the value up, dropped fraction digits don't
+    int int_digits = scan_digits(p, end, mant, num_digits, truncated, dropped);
+    int exp10 = dropped;
+    int frac_digits = 0;
+    if (p < end && *p == '.') {
+        ++p;
+        frac_digits = scan_digits(p, end, mant, num_digits, truncated, dropped);
+        exp10 -= frac_digits;
+    }
+    if (int_digits + frac_digits + dropped == 0) {
+        return false;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool exp_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_negative = (*p == '-');
+            ++p;
+        }
+        if (p == end || unsigned(*p - '0') >= 10) {
+            return false;
+        }
+        int e = 0;
+        while (p < end && unsigned(*p - '0') < 10) {
+            if (e < 100000) {
+                e = e*10 + (*p - '0');
+            }
+            ++p;
+        }
+        exp10 += exp_negative ? -e : e;
+    }
+    if (p != end) {
+        return false;
+    }
+
+    if (mant == 0 && !truncated) {
+        out = negative ? -0.0f : 0.0f;
+        return true;
+    }
+
+    if (!truncated) {
+        // Both operands are exact, so a single multiply or divide rounds correctly
+        if (mant <= (1ULL << 24) && exp10 >= -10 && exp10 <= 10) {
+            float val = float(mant);
+            val = (exp10 < 0) ? val / FLOAT_POW10[-exp10] : val * FLOAT_POW10[exp10];
+            out = negative ? -val : val;
+            return true;
+        }
+        // Same idea in double, which is correctly rounded as a double...
+        if (mant <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+            double val = double(mant);
+            val = (exp10 < 0) ? val / DOUBLE_POW10[-exp10] : val * DOUBLE_POW10[exp10];
+            // ...but narrowing it to float rounds twice.  That only goes wrong when the
+            // double lands exactly halfway between two floats, so send those to the slow path.
+            uint64_t bits;
+            std::memcpy(&bits, &val, sizeof(bits));
+            bool halfway = (bits & 0x1FFFFFFFULL) == 0x10000000ULL;
+            if (!halfway && val >= double(FLT_MIN) && val <= double(FLT_MAX)) {
+                out = negative ? -float(val) : float(val);
+                return true;
+            }
+        }
+    }
+    return parse_float_slow(begin, end, out);
+}
+
+void use_c_decimal_point(char *buf, size_t len) {
+    char point = std::localeconv()->decimal_point[0];
+    if (point == '.') {
+        return;
+    }
+    for (size_t i=0; i<len; ++i) {
+        if (buf[i] == point) {
+            buf[i] = '.';
+        }
+    }
+}
+
+int format_float(char *buf, const char *format, double value) {
+    int len = std::sprintf(buf, format, value);
+    if (len > 0) {
+        use_c_decimal_point(buf, size_t(len));
+    }
+    return len;
+}
@@ -0,0 +1,45 @@
+/*
+  fastfloat.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef FAST_FLOAT_HEADER
+#define FAST_FLOAT_HEADER
+
+#include <cstddef>
+
+/*!
+  Parses the decimal number in [begin, end) directly to a correctly rounded float.
+  The whole range must be the number, with no surrounding whitespace.
+  Always uses '.' as the decimal point, regardless of the current locale.
+  Returns false if the text isn't a valid number.
+*/
+bool parse_float(const char *begin, const char *end, float &out);
+
+/*!
+  Turns the current locale's decimal point back into '.' in the len
+  chars at buf, for text printf formatted under a comma locale.  buf must
+  not otherwise contain that character.
+*/
+void use_c_decimal_point(char *buf, std::size_t len);
+
+/*!
+  sprintf for a single floating point conversion such as "%.8e", always
+  with '.' as the decimal point.  Returns the length written.
+*/
+int format_float(char *buf, const char *format, double value);
+
+#endif
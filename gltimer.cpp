@@ -0,0 +1,144 @@
+/*
+  gltimer.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cstring>
+
+#include "gltimer.h"
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+// Queries waiting for results.  Past this the GPU is far behind, so skip timing.
+static const size_t MAX_PENDING_QUERIES = 64;
+
+// Looks up name, or name with the suffix for older drivers
+static void *resolve(const QGLContext *context, const char *name, const char *suffix) {
+    return context->getProcAddress(QString::fromLatin1(name) + QString::fromLatin1(suffix));
+}
+
+GLTimerQueries::GLTimerQueries() : genQueries(0), deleteQueries(0), beginQuery(0), endQuery(0),
+                                   getQueryObjectiv(0), getQueryObjectui64v(0), active(false) {
+}
+
+void GLTimerQueries::init() {
+    const QGLContext *context = QGLContext::currentContext();
+    const char *extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (!context || !extensions) {
+        return;
+    }
+    const char *suffix = "";
+    if (std::strstr(extensions, "GL_ARB_timer_query")) {
+        getQueryObjectui64v = (GetQueryObjectui64vProc)resolve(context, "glGetQueryObjectui64v", "");
+    } else if (std::strstr(extensions, "GL_EXT_timer_query")) {
+        getQueryObjectui64v = (GetQueryObjectui64vProc)resolve(context, "glGetQueryObjectui64v", "EXT");
+        // Drivers old enough to only have the EXT version may lack OpenGL 1.5's names
+        if (!resolve(context, "glGenQueries", "")) {
+            suffix = "ARB";
+        }
+    }
+    if (!getQueryObjectui64v) {
+        return;
+    }
+    genQueries = (GenQueriesProc)resolve(context, "glGenQueries", suffix);
+    deleteQueries = (DeleteQueriesProc)resolve(context, "glDeleteQueries", suffix);
+    beginQuery = (BeginQueryProc)resolve(context, "glBeginQuery", suffix);
+    endQuery = (EndQueryProc)resolve(context, "glEndQuery", suffix);
+    getQueryObjectiv = (GetQueryObjectivProc)resolve(context, "glGetQueryObjectiv", suffix);
+    if (!isSupported()) {
+        getQueryObjectui64v = 0;
+    }
+}
+
+void GLTimerQueries::destroy() {
+    if (deleteQueries) {
+        for (size_t i=0; i<pending.size(); ++i) {
+            freeQueries.push_back(pending[i].query);
+        }
+        if (!freeQueries.empty()) {
+            deleteQueries(GLsizei(freeQueries.size()), &freeQueries[0]);
+        }
+    }
+    freeQueries.clear();
+    pending.clear();
+    active = false;
+}
+
+bool GLTimerQueries::isSupported() const {
+    return genQueries && deleteQueries && beginQuery && endQuery &&
+        getQueryObjectiv && getQueryObjectui64v;
+}
+
+bool GLTimerQueries::begin(const char *name) {
+    if (!Profiler::isEnabled() || active || !getQueryObjectui64v ||
+        pending.size() >= MAX_PENDING_QUERIES) {
+        return false;
+    }
+    if (freeQueries.empty()) {
+        GLuint query = 0;
+        genQueries(1, &query);
+        freeQueries.push_back(query);
+    }
+    Pending p = {freeQueries.back(), name, Profiler::now()};
+    freeQueries.pop_back();
+    beginQuery(GL_TIME_ELAPSED, p.query);
+    pending.push_back(p);
+    active = true;
+    return true;
+}
+
+void GLTimerQueries::end() {
+    if (active) {
+        endQuery(GL_TIME_ELAPSED);
+        active = false;
+    }
+}
+
+/*!
+  Queries finish in the order they were issued, so this stops at the first
+  that hasn't.  GPU spans are placed at the time their commands were issued.
+*/
+void GLTimerQueries::collect() {
+    if (active) {
+        return;
+    }
+    size_t done = 0;
+    while (done < pending.size()) {
+        GLint available = 0;
+        getQueryObjectiv(pending[done].query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        quint64 nsecs = 0;
+        getQueryObjectui64v(pending[done].query, GL_QUERY_RESULT, &nsecs);
+        // Some drivers return garbage for a query object's first use, and
+        // the GPU can't have spent longer on it than has passed since
+        if (qint64(nsecs) <= Profiler::now() - pending[done].cpuStart) {
+            Profiler::record(pending[done].name, pending[done].cpuStart, qint64(nsecs), true);
+        }
+        freeQueries.push_back(pending[done].query);
+        ++done;
+    }
+    pending.erase(pending.begin(), pending.begin() + done);
+}
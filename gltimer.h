@@ -0,0 +1,106 @@
+/*
+  gltimer.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef GL_TIMER_HEADER
+#define GL_TIMER_HEADER
+
+#include <QtOpenGL>
+
+#ifdef __APPLE_CC__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#include <vector>
+
+#include "profiler.h"
+
+/*!
+  GPU timers for one OpenGL context, using GL_TIME_ELAPSED queries from
+  ARB_timer_query or EXT_timer_query.  Results arrive a frame or two late,
+  so collect() picks up whichever have finished.  Those queries can't nest,
+  so only the outermost GLProfileScope at a time is timed on the GPU.
+*/
+class GLTimerQueries {
+public:
+    GLTimerQueries();
+
+    // Looks up the query functions, with the context current
+    void init();
+    // Deletes the queries, with the context current
+    void destroy();
+    bool isSupported() const;
+
+    // False if unsupported, disabled or a query is already running
+    bool begin(const char *name);
+    void end();
+    // Records the finished queries as GPU spans
+    void collect();
+
+private:
+    struct Pending {
+        GLuint query;
+        const char *name;
+        qint64 cpuStart;
+    };
+
+    typedef void (APIENTRY *GenQueriesProc)(GLsizei n, GLuint *ids);
+    typedef void (APIENTRY *DeleteQueriesProc)(GLsizei n, const GLuint *ids);
+    typedef void (APIENTRY *BeginQueryProc)(GLenum target, GLuint id);
+    typedef void (APIENTRY *EndQueryProc)(GLenum target);
+    typedef void (APIENTRY *GetQueryObjectivProc)(GLuint id, GLenum pname, GLint *params);
+    typedef void (APIENTRY *GetQueryObjectui64vProc)(GLuint id, GLenum pname, quint64 *params);
+
+    GenQueriesProc genQueries;
+    DeleteQueriesProc deleteQueries;
+    BeginQueryProc beginQuery;
+    EndQueryProc endQuery;
+    GetQueryObjectivProc getQueryObjectiv;
+    GetQueryObjectui64vProc getQueryObjectui64v;
+
+    std::vector<GLuint> freeQueries;
+    std::vector<Pending> pending;
+    bool active;
+};
+
+/*!
+  Times a block of OpenGL calls on the CPU, and on the GPU where it can
+*/
+class GLProfileScope {
+public:
+    GLProfileScope(GLTimerQueries &timer, const char *name) : cpu(name), timer(timer),
+                                                             timing(timer.begin(name)) {
+    }
+    ~GLProfileScope() {
+        if (timing) {
+            timer.end();
+        }
+    }
+
+private:
+    ProfileScope cpu;
+    GLTimerQueries &timer;
+    bool timing;
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+  lodbuilder.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QElapsedTimer>
+
+#include "lodbuilder.h"
+#include "meshsimplify.h"
+#include "profiler.h"
+
+LODBuilder::LODBuilder(STLFile *file, size_t keepTris, size_t minTris, QObject *parent) :
+    QThread(parent), stlf(file), keep(keepTris), minimum(minTris), weldTime(0.0),
+    cancelRequested(false) {
+}
+
+/*!
+  Cancels and waits for the build if it's still running
+*/
+LODBuilder::~LODBuilder() {
+    cancel();
+    wait();
+    for (size_t i=0; i<chain.size(); ++i) {
+        delete chain[i];
+    }
+}
+
+void LODBuilder::takeLevels(std::vector<LODLevel*> &levels) {
+    levels.swap(chain);
+    chain.clear();
+}
+
+bool LODBuilder::wasCancelled() const {
+    return cancelRequested;
+}
+
+double LODBuilder::weldSeconds() const {
+    return weldTime;
+}
+
+/*!
+  Asks the build to stop.  It stops after the current simplification pass.
+*/
+void LODBuilder::cancel() {
+    cancelRequested = true;
+}
+
+void LODBuilder::run() {
+    ProfileScope profile("build detail levels");
+    try {
+        QElapsedTimer timer;
+        timer.start();
+        // Simplification needs shared vertices to know which edges to collapse
+        std::vector<float> verts, norms;
+        std::vector<unsigned int> indices;
+        stlf->buildIndexedMesh(1.0e-6f*stlf->getBoundingRadius(), verts, norms, indices);
+        std::vector<float>().swap(norms);
+        MeshSimplifier simplifier(verts, indices);
+        std::vector<float>().swap(verts);
+        std::vector<unsigned int>().swap(indices);
+        weldTime = timer.elapsed()/1000.0;
+
+        size_t target = stlf->getNumTris()/4;
+        while (target >= minimum && !cancelRequested) {
+            timer.restart();
+            if (!simplifier.simplify(target, &cancelRequested)) {
+                break;
+            }
+            LODLevel *level = new LODLevel;
+            level->numTris = simplifier.getNumTris();
+            level->error = simplifier.getMaxError();
+            if (level->numTris <= keep) {
+                simplifier.getTriangles(level->positions, level->normals);
+            }
+            level->seconds = timer.elapsed()/1000.0;
+            chain.push_back(level);
+
+            if (level->numTris > target) {
+                // Nothing left that can be collapsed without wrecking the shape
+                break;
+            }
+            target = level->numTris/4;
+        }
+    } catch (std::bad_alloc &) {
+        // No levels past this point, the full model still draws
+    }
+}
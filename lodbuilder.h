@@ -0,0 +1,76 @@
+/*
+  lodbuilder.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef LOD_BUILDER_HEADER
+#define LOD_BUILDER_HEADER
+
+#include <QThread>
+
+#include <vector>
+
+#include "stlfile.h"
+
+/*!
+  One simplified version of the model, as a triangle soup with face normals
+*/
+struct LODLevel {
+    std::vector<float> positions;
+    std::vector<float> normals;
+    size_t numTris;
+    // Bound on how far the vertices strayed from the planes of the full
+    // model's triangles, in model units.  See MeshSimplifier::getMaxError.
+    double error;
+    // Time to simplify from the previous level
+    double seconds;
+};
+
+/*!
+  Builds a chain of simplified levels of an STLFile on a worker thread.
+  Each level has about a quarter of the triangles of the one before, down
+  to minTris.  Only levels with at most keepTris triangles keep their
+  geometry, the others are just reported.
+  The STLFile must stay alive until the thread has finished.
+*/
+class LODBuilder : public QThread {
+    Q_OBJECT;
+
+public:
+    LODBuilder(STLFile *file, size_t keepTris, size_t minTris, QObject *parent = 0);
+    ~LODBuilder();
+
+    // Only valid after the thread has finished.  Finest level first.
+    void takeLevels(std::vector<LODLevel*> &levels);
+    bool wasCancelled() const;
+    double weldSeconds() const;
+
+public slots:
+    void cancel();
+
+protected:
+    void run();
+
+private:
+    STLFile *stlf;
+    size_t keep;
+    size_t minimum;
+    std::vector<LODLevel*> chain;
+    double weldTime;
+    volatile bool cancelRequested;
+};
+
+#endif
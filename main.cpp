@@ -20,14 +20,46 @@
 #include <QtGui>
 #include <QtOpenGL>
 #include <iostream>
+#include <cstring>
 
 #include "mainwindow.h"
+#include "batch.h"
+#include "thumbnailer.h"
+#include "softviewer.h"
 
 int main(int argc, char *argv[]) {
+  // Headless modes run before QApplication so they work without a display
+  if (argc > 1 && 0 == std::strcmp(argv[1], "--stats")) {
+    return runStats(argc-2, argv+2);
+  }
+  if (argc > 1 && 0 == std::strcmp(argv[1], "--convert")) {
+    return runConvert(argc-2, argv+2);
+  }
+
+  bool thumbnails = argc > 1 && 0 == std::strcmp(argv[1], "--thumbnails");
+#if QT_VERSION >= 0x040800
+  // The thumbnail pool drives a pbuffer from each of its threads, which
+  // needs Xlib's thread support turned on before the display is opened
+  if (thumbnails) {
+    QApplication::setAttribute(Qt::AA_X11InitThreads);
+  }
+#endif
+
   QApplication app(argc, argv);
+  // Renders offscreen, but Qt still needs a display to create OpenGL contexts.
+  // Without OpenGL it falls back to the software rasterizer.
+  if (thumbnails) {
+    return runThumbnails(argc-2, argv+2);
+  }
   if (!QGLFormat::hasOpenGL()) {
-    std::cerr << "This system has no OpenGL support" << std::endl;
-    return 1;
+    std::cerr << "This system has no OpenGL support, using software rendering" << std::endl;
+    SoftViewer *softViewer = new SoftViewer;
+    softViewer->resize(600,600);
+    softViewer->show();
+    if (argc > 1) {
+      softViewer->openFile(QFile::decodeName(argv[1]));
+    }
+    return app.exec();
   }
 
   MainWindow *mainWin = new MainWindow;
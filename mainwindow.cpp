@@ -18,17 +18,23 @@
 
 #include <QtGui>
 #include <QSettings>
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#endif
 
 #include <cstdlib>
+#include <stdexcept>
 
 #include "mainwindow.h"
 
 #include "stlviewer.h"
+#include "profiler.h"
 
 /*!
   Performs initialization
 */
-MainWindow::MainWindow() : QMainWindow(), promptExit(true), showingFacets(true), showingPolygons(true), showingNormals(true) {
+MainWindow::MainWindow() : QMainWindow(), promptExit(true), showingFacets(true), showingPolygons(true), showingNormals(true), weldingVertices(false), compactingStorage(false),
+                           loadingProgressively(true), cachingFiles(true), highlightingNormals(false), profiling(false) {
   
     // Create STLViewer widget
     stl = new STLViewer(this);
@@ -37,6 +43,19 @@ MainWindow::MainWindow() : QMainWindow(), promptExit(true), showingFacets(true),
                          "STLViewer", "STLViewer");
 
     readSettings();
+
+    // Parsed files are cached here so reopening them skips the parse
+#if QT_VERSION >= 0x050000
+    cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+#else
+    cacheDir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+    if (!cacheDir.isEmpty() && QDir().mkpath(cacheDir)) {
+        stl->setCacheDir(cacheDir);
+    } else {
+        cacheDir = QString();
+        cachingFiles = false;
+    }
   
     // Make the STLViewer the central widget 
     setCentralWidget(stl);
@@ -53,15 +72,21 @@ MainWindow::MainWindow() : QMainWindow(), promptExit(true), showingFacets(true),
 MainWindow::~MainWindow() {
     // Delete everything
     delete openFileAction;
+    delete saveFileAction;
     delete aboutAction;
     delete aboutQtAction;
     delete quitAction;
     delete resetViewAction;
+    delete cancelLoadAction;
+    delete repairNormalsAction;
+    delete profileAction;
+    delete exportTraceAction;
 
     delete theToolbar;
   
     delete fileMenu;
     delete optionsMenu;
+    delete toolsMenu;
     delete helpMenu;
     delete statusLabel;
     delete tbIcon;
@@ -80,6 +105,13 @@ void MainWindow::createActions() {
     openFileAction->setStatusTip(tr("Open an STL file"));
     connect(openFileAction, SIGNAL(triggered()), this, SLOT(openFile()));
 
+    // Save As
+    saveFileAction = new QAction(tr("Save &As..."), this);
+    saveFileAction->setShortcut(tr("Ctrl+Shift+S"));
+    saveFileAction->setStatusTip(tr("Save the model as a binary or ASCII STL file"));
+    saveFileAction->setEnabled(false);
+    connect(saveFileAction, SIGNAL(triggered()), this, SLOT(saveFile()));
+
     // About
     aboutAction = new QAction(tr("About"), this);
     aboutAction->setIcon(QIcon(":/images/about.png"));
@@ -106,6 +138,31 @@ void MainWindow::createActions() {
     resetViewAction->setShortcut(tr("Ctrl+V"));
     resetViewAction->setStatusTip(tr("Reset the view"));
     connect(resetViewAction, SIGNAL(triggered()), this, SLOT(resetView()));
+
+    // Cancel loading
+    cancelLoadAction = new QAction(tr("Cancel Load"), this);
+    cancelLoadAction->setIcon(QIcon(":/images/quit.png"));
+    cancelLoadAction->setShortcut(tr("Esc"));
+    cancelLoadAction->setStatusTip(tr("Stop loading the file being opened"));
+    cancelLoadAction->setEnabled(false);
+    connect(cancelLoadAction, SIGNAL(triggered()), stl, SLOT(cancelLoad()));
+
+    // Repair normals
+    repairNormalsAction = new QAction(tr("Repair Normals"), this);
+    repairNormalsAction->setStatusTip(tr("Make the facet winding consistent, turn closed shells outward and recompute the normals"));
+    connect(repairNormalsAction, SIGNAL(triggered()), stl, SLOT(repairNormals()));
+
+    // Profiling, which the viewer may have started already
+    profiling = Profiler::isEnabled();
+    profileAction = new QAction(tr("Profile Rendering"), this);
+    profileAction->setStatusTip(tr("Time loading, uploads and drawing, and show the times over the model."));
+    profileAction->setCheckable(true);
+    profileAction->setChecked(profiling);
+    connect(profileAction, SIGNAL(triggered()), this, SLOT(toggleProfiling()));
+
+    exportTraceAction = new QAction(tr("Export Profile Trace..."), this);
+    exportTraceAction->setStatusTip(tr("Save the recorded times as a Chrome trace, for chrome://tracing or Perfetto."));
+    connect(exportTraceAction, SIGNAL(triggered()), this, SLOT(exportTrace()));
     
     showFacetsAction = new QAction(tr("Show Facets"), this);
     showFacetsAction->setStatusTip(tr("Show facet outlines."));
@@ -124,6 +181,37 @@ void MainWindow::createActions() {
     showNormalsAction->setCheckable(true);
     showNormalsAction->setChecked(showingNormals);
     connect(showNormalsAction, SIGNAL(triggered()), this, SLOT(toggleNormals()));
+
+    weldVerticesAction = new QAction(tr("Weld Vertices"), this);
+    weldVerticesAction->setStatusTip(tr("Share identical vertices between facets and smooth the shading."));
+    weldVerticesAction->setCheckable(true);
+    weldVerticesAction->setChecked(weldingVertices);
+    connect(weldVerticesAction, SIGNAL(triggered()), this, SLOT(toggleWelding()));
+
+    compactStorageAction = new QAction(tr("Compact Vertex Storage"), this);
+    compactStorageAction->setStatusTip(tr("Store 16 bit positions and 8 bit normals on the GPU, less than half the memory for a small loss of precision."));
+    compactStorageAction->setCheckable(true);
+    compactStorageAction->setChecked(compactingStorage);
+    connect(compactStorageAction, SIGNAL(triggered()), this, SLOT(toggleCompact()));
+
+    progressiveLoadAction = new QAction(tr("Progressive Loading"), this);
+    progressiveLoadAction->setStatusTip(tr("Draw files while they're still loading."));
+    progressiveLoadAction->setCheckable(true);
+    progressiveLoadAction->setChecked(loadingProgressively);
+    connect(progressiveLoadAction, SIGNAL(triggered()), this, SLOT(toggleProgressive()));
+
+    cacheFilesAction = new QAction(tr("Cache Parsed Files"), this);
+    cacheFilesAction->setStatusTip(tr("Keep parsed copies of opened files so they reopen instantly."));
+    cacheFilesAction->setCheckable(true);
+    cacheFilesAction->setChecked(cachingFiles);
+    cacheFilesAction->setEnabled(!cacheDir.isEmpty());
+    connect(cacheFilesAction, SIGNAL(triggered()), this, SLOT(toggleCache()));
+
+    badNormalsAction = new QAction(tr("Highlight Bad Normals"), this);
+    badNormalsAction->setStatusTip(tr("Check facet normals against their winding and highlight flipped and degenerate facets."));
+    badNormalsAction->setCheckable(true);
+    badNormalsAction->setChecked(highlightingNormals);
+    connect(badNormalsAction, SIGNAL(triggered()), this, SLOT(toggleBadNormals()));
 }
 
 /*!
@@ -133,6 +221,8 @@ void MainWindow::createMenus() {
     // Game menu
     fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(openFileAction);
+    fileMenu->addAction(saveFileAction);
+    fileMenu->addAction(cancelLoadAction);
     fileMenu->addSeparator();
     fileMenu->addAction(openFileAction);
     fileMenu->addSeparator();
@@ -143,6 +233,19 @@ void MainWindow::createMenus() {
     optionsMenu->addAction(showPolygonsAction);
     optionsMenu->addAction(showFacetsAction);
     optionsMenu->addAction(showNormalsAction);
+    optionsMenu->addAction(badNormalsAction);
+    optionsMenu->addSeparator();
+    optionsMenu->addAction(weldVerticesAction);
+    optionsMenu->addAction(compactStorageAction);
+    optionsMenu->addAction(progressiveLoadAction);
+    optionsMenu->addAction(cacheFilesAction);
+
+    // Tools menu
+    toolsMenu = menuBar()->addMenu(tr("&Tools"));
+    toolsMenu->addAction(repairNormalsAction);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction(profileAction);
+    toolsMenu->addAction(exportTraceAction);
 
     // Help menu
     helpMenu = menuBar()->addMenu(tr("&Help"));
@@ -158,6 +261,7 @@ void MainWindow::createToolbar() {
     theToolbar = addToolBar(tr("File"));
     theToolbar->addAction(openFileAction);
     theToolbar->addAction(resetViewAction);
+    theToolbar->addAction(cancelLoadAction);
 }
 
 /*!
@@ -170,6 +274,19 @@ void MainWindow::createStatusBar() {
     // Then set its minimum size and add to the status bar
     statusLabel->setMinimumSize(statusLabel->sizeHint());
     statusBar()->addWidget(statusLabel);
+
+    // Only visible while a file is loading
+    loadProgressBar = new QProgressBar;
+    loadProgressBar->setRange(0, 1000);
+    loadProgressBar->setMaximumWidth(200);
+    loadProgressBar->hide();
+    statusBar()->addPermanentWidget(loadProgressBar);
+
+    connect(stl, SIGNAL(statusMessage(QString)), statusBar(), SLOT(showMessage(QString)));
+    connect(stl, SIGNAL(loadStarted(QString)), this, SLOT(loadStarted(QString)));
+    connect(stl, SIGNAL(loadProgress(qint64, qint64, qint64)),
+            this, SLOT(loadProgress(qint64, qint64, qint64)));
+    connect(stl, SIGNAL(loadFinished(QString, bool)), this, SLOT(loadFinished(QString, bool)));
 }
 
 /*!
@@ -191,11 +308,88 @@ void MainWindow::openFile() {
     if (fileName == tr("")) {
         return;
     }
-    if (stl->openFile(fileName)) {
-        updateStatusBar(fileName);
+    stl->openFile(fileName);
+}
+
+/*!
+  Asks where to save the model and in which format
+*/
+void MainWindow::saveFile() {
+    QString binaryFilter = tr("Binary STL File (*.stl)");
+    QString selectedFilter = binaryFilter;
+    QString fileName =
+        QFileDialog::getSaveFileName(this,
+                                     tr("Save as..."),
+                                     currentFile,
+                                     binaryFilter + tr(";;ASCII STL File (*.stl)"),
+                                     &selectedFilter);
+    if (fileName.isEmpty()) {
+        return;
+    }
+    stl->saveFile(fileName, selectedFilter == binaryFilter);
+}
+
+/*!
+  Writes everything recorded since profiling started
+*/
+void MainWindow::exportTrace() {
+    if (Profiler::numEvents() == 0) {
+        QMessageBox::information(this, tr("STL Viewer"),
+                                 tr("Nothing has been recorded yet.  Turn on Tools > Profile Rendering first."));
+        return;
+    }
+    QString fileName =
+        QFileDialog::getSaveFileName(this,
+                                     tr("Export profile trace..."),
+                                     tr("stlviewer-trace.json"),
+                                     tr("Chrome Trace (*.json);;All Files (*)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+    try {
+        Profiler::exportTrace(QFile::encodeName(fileName).constData());
+        updateStatusBar(tr("Wrote %1 spans to %2").arg(Profiler::numEvents()).arg(fileName));
+    } catch (std::runtime_error &re) {
+        QMessageBox::critical(this, tr("STL Viewer"), QString(re.what()));
     }
 }
 
+/*!
+  Shows the progress bar and enables cancelling when a load starts
+*/
+void MainWindow::loadStarted(QString fileName) {
+    loadProgressBar->setValue(0);
+    loadProgressBar->show();
+    cancelLoadAction->setEnabled(true);
+    updateStatusBar(tr("Loading %1...").arg(fileName));
+}
+
+/*!
+  Updates the progress bar while a file loads
+*/
+void MainWindow::loadProgress(qint64 bytesDone, qint64 bytesTotal, qint64 trisDone) {
+    if (bytesTotal > 0) {
+        loadProgressBar->setValue(int(1000*bytesDone/bytesTotal));
+    }
+    statusBar()->showMessage(tr("%1 MB read, %2 triangles")
+                             .arg(double(bytesDone)/(1024.0*1024.0), 0, 'f', 1)
+                             .arg(trisDone));
+}
+
+/*!
+  Hides the progress bar and shows the file that's being displayed
+*/
+void MainWindow::loadFinished(QString fileName, bool loaded) {
+    loadProgressBar->hide();
+    cancelLoadAction->setEnabled(false);
+    statusBar()->clearMessage();
+    if (loaded) {
+        currentFile = fileName;
+    }
+    saveFileAction->setEnabled(!currentFile.isEmpty());
+    updateStatusBar(currentFile.isEmpty() ? tr("No file loaded") : currentFile);
+}
+
 /*!
   Display the about box
 */
@@ -248,3 +442,39 @@ void MainWindow::toggleNormals() {
         stl->setShowNormals(showingNormals);
     }
 }
+void MainWindow::toggleCompact() {
+    compactingStorage = !compactingStorage;
+    if (stl) {
+        stl->setCompactStorage(compactingStorage);
+    }
+}
+void MainWindow::toggleWelding() {
+    weldingVertices = !weldingVertices;
+    if (stl) {
+        stl->setWeldVertices(weldingVertices);
+    }
+}
+void MainWindow::toggleProgressive() {
+    loadingProgressively = !loadingProgressively;
+    if (stl) {
+        stl->setProgressiveLoad(loadingProgressively);
+    }
+}
+void MainWindow::toggleBadNormals() {
+    highlightingNormals = !highlightingNormals;
+    if (stl) {
+        stl->setHighlightNormals(highlightingNormals);
+    }
+}
+void MainWindow::toggleProfiling() {
+    profiling = !profiling;
+    if (stl) {
+        stl->setProfiling(profiling);
+    }
+}
+void MainWindow::toggleCache() {
+    cachingFiles = !cachingFiles;
+    if (stl) {
+        stl->setCacheDir(cachingFiles ? cacheDir : QString());
+    }
+}
@@ -25,6 +25,7 @@
 
 class QAction;
 class QLabel;
+class QProgressBar;
 class QIcon;
 class QMenu;
 class QToolBar;
@@ -43,12 +44,23 @@ public:
 
 private slots:
     void openFile();
+    void saveFile();
     void about();
     void resetView();
     void updateStatusBar(QString fileName);
     void toggleFacets();
     void togglePolygons();
     void toggleNormals();
+    void toggleWelding();
+    void toggleCompact();
+    void toggleProgressive();
+    void toggleCache();
+    void toggleBadNormals();
+    void toggleProfiling();
+    void exportTrace();
+    void loadStarted(QString fileName);
+    void loadProgress(qint64 bytesDone, qint64 bytesTotal, qint64 trisDone);
+    void loadFinished(QString fileName, bool loaded);
 
 protected:
     // Initialization functions
@@ -61,31 +73,51 @@ protected:
     void readSettings();
 private:
     QAction *openFileAction;
+    QAction *saveFileAction;
     QAction *aboutAction;
     QAction *aboutQtAction;
     QAction *quitAction;
     QAction *resetViewAction;
+    QAction *cancelLoadAction;
 
     QAction *showFacetsAction;
     QAction *showPolygonsAction;
     QAction *showNormalsAction;
+    QAction *weldVerticesAction;
+    QAction *compactStorageAction;
+    QAction *progressiveLoadAction;
+    QAction *cacheFilesAction;
+    QAction *badNormalsAction;
+    QAction *repairNormalsAction;
+    QAction *profileAction;
+    QAction *exportTraceAction;
 
     QToolBar *theToolbar;
   
     QMenu *fileMenu;
     QMenu *optionsMenu;
+    QMenu *toolsMenu;
     QMenu *helpMenu;
     QLabel *statusLabel;
+    QProgressBar *loadProgressBar;
     QIcon *tbIcon;
 
     QSettings *qset;
 
     STLViewer *stl;
+    QString currentFile;
 
     bool promptExit;
     bool showingFacets;
     bool showingPolygons;
     bool showingNormals;
+    bool weldingVertices;
+    bool compactingStorage;
+    bool loadingProgressively;
+    bool cachingFiles;
+    bool highlightingNormals;
+    bool profiling;
+    QString cacheDir;
 };
 
 #endif
@@ -0,0 +1,113 @@
+/*
+  mappedfile.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "mappedfile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(std::string fname) : fdata(0), fsize(0), fileHandle(INVALID_HANDLE_VALUE), mapHandle(0) {
+    fileHandle = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error(std::string("Cannot open file ") + fname);
+    }
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(fileHandle, &sz)) {
+        CloseHandle(fileHandle);
+        throw std::runtime_error(std::string("Cannot get size of file ") + fname);
+    }
+    fsize = size_t(sz.QuadPart);
+    if (fsize == 0) {
+        return;
+    }
+    mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapHandle == 0) {
+        CloseHandle(fileHandle);
+        throw std::runtime_error(std::string("Cannot map file ") + fname);
+    }
+    fdata = (const char*)MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+    if (fdata == 0) {
+        CloseHandle(mapHandle);
+        CloseHandle(fileHandle);
+        throw std::runtime_error(std::string("Cannot map file ") + fname);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (fdata) {
+        UnmapViewOfFile(fdata);
+    }
+    if (mapHandle) {
+        CloseHandle(mapHandle);
+    }
+    CloseHandle(fileHandle);
+}
+
+#else
+
+MappedFile::MappedFile(std::string fname) : fdata(0), fsize(0), fd(-1) {
+    fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Cannot open file ") + fname);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error(std::string("Cannot get size of file ") + fname);
+    }
+    fsize = size_t(st.st_size);
+    if (fsize == 0) {
+        return;
+    }
+    void *addr = mmap(0, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error(std::string("Cannot map file ") + fname);
+    }
+    // The whole file gets read front to back, so let the kernel read ahead aggressively
+    madvise(addr, fsize, MADV_SEQUENTIAL);
+    fdata = (const char*)addr;
+}
+
+MappedFile::~MappedFile() {
+    if (fdata) {
+        munmap((void*)fdata, fsize);
+    }
+    close(fd);
+}
+
+#endif
+
+const char *MappedFile::data() const {
+    return fdata;
+}
+
+size_t MappedFile::size() const {
+    return fsize;
+}
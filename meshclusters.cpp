@@ -0,0 +1,163 @@
+/*
+  meshclusters.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cfloat>
+#include <algorithm>
+
+#include "meshclusters.h"
+
+// Bits of the Morton code per axis
+static const int MORTON_BITS = 10;
+// Radix sort digit size, three passes cover the 30 bit codes
+static const int RADIX_BITS = 10;
+
+// Spreads the low 10 bits of x out to every third bit
+static inline unsigned int spreadBits(unsigned int x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+static inline size_t cornerOf(const unsigned int *indices, size_t tri, size_t k) {
+    return indices ? indices[3*tri+k] : 3*tri+k;
+}
+
+void buildClusters(const float *positions, const unsigned int *indices, size_t num_tris,
+                   size_t cluster_size, std::vector<unsigned int> &order,
+                   std::vector<MeshCluster> &clusters) {
+    order.clear();
+    clusters.clear();
+    if (num_tris == 0 || cluster_size == 0) {
+        return;
+    }
+
+    std::vector<float> centroids(3*num_tris);
+    float cmin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float cmax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+#pragma omp parallel
+    {
+        float lmin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+        float lmax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+#pragma omp for nowait
+        for (long i=0; i<long(num_tris); ++i) {
+            const float *v0 = positions + 3*cornerOf(indices, i, 0);
+            const float *v1 = positions + 3*cornerOf(indices, i, 1);
+            const float *v2 = positions + 3*cornerOf(indices, i, 2);
+            for (size_t k=0; k<3; ++k) {
+                float c = (v0[k] + v1[k] + v2[k])*(1.0f/3.0f);
+                centroids[3*i+k] = c;
+                lmin[k] = std::min(lmin[k], c);
+                lmax[k] = std::max(lmax[k], c);
+            }
+        }
+#pragma omp critical(cluster_bounds)
+        for (size_t k=0; k<3; ++k) {
+            cmin[k] = std::min(cmin[k], lmin[k]);
+            cmax[k] = std::max(cmax[k], lmax[k]);
+        }
+    }
+
+    float scale[3];
+    for (size_t k=0; k<3; ++k) {
+        float extent = cmax[k] - cmin[k];
+        scale[k] = extent > 0.0f ? float((1<<MORTON_BITS) - 1)/extent : 0.0f;
+    }
+    std::vector<unsigned int> codes(num_tris);
+    order.resize(num_tris);
+#pragma omp parallel for
+    for (long i=0; i<long(num_tris); ++i) {
+        unsigned int code = 0;
+        for (size_t k=0; k<3; ++k) {
+            unsigned int q = (unsigned int)((centroids[3*i+k] - cmin[k])*scale[k]);
+            code |= spreadBits(q) << k;
+        }
+        codes[i] = code;
+        order[i] = (unsigned int)i;
+    }
+    std::vector<float>().swap(centroids);
+
+    // LSD radix sort of the triangle numbers by code
+    std::vector<unsigned int> tmpCodes(num_tris);
+    std::vector<unsigned int> tmpOrder(num_tris);
+    const unsigned int buckets = 1u << RADIX_BITS;
+    for (int shift=0; shift<3*MORTON_BITS; shift+=RADIX_BITS) {
+        std::vector<size_t> offsets(buckets+1, 0);
+        for (size_t i=0; i<num_tris; ++i) {
+            ++offsets[((codes[i] >> shift) & (buckets-1)) + 1];
+        }
+        for (unsigned int b=0; b<buckets; ++b) {
+            offsets[b+1] += offsets[b];
+        }
+        for (size_t i=0; i<num_tris; ++i) {
+            size_t dest = offsets[(codes[i] >> shift) & (buckets-1)]++;
+            tmpCodes[dest] = codes[i];
+            tmpOrder[dest] = order[i];
+        }
+        codes.swap(tmpCodes);
+        order.swap(tmpOrder);
+    }
+
+    size_t num_clusters = (num_tris + cluster_size - 1)/cluster_size;
+    clusters.resize(num_clusters);
+#pragma omp parallel for
+    for (long c=0; c<long(num_clusters); ++c) {
+        MeshCluster &cluster = clusters[c];
+        cluster.first = size_t(c)*cluster_size;
+        cluster.count = std::min(cluster_size, num_tris - cluster.first);
+        for (size_t k=0; k<3; ++k) {
+            cluster.bmin[k] = FLT_MAX;
+            cluster.bmax[k] = -FLT_MAX;
+        }
+        for (size_t i=cluster.first; i<cluster.first+cluster.count; ++i) {
+            for (size_t j=0; j<3; ++j) {
+                const float *v = positions + 3*cornerOf(indices, order[i], j);
+                for (size_t k=0; k<3; ++k) {
+                    cluster.bmin[k] = std::min(cluster.bmin[k], v[k]);
+                    cluster.bmax[k] = std::max(cluster.bmax[k], v[k]);
+                }
+            }
+        }
+    }
+}
+
+void extractFrustum(const float m[16], float planes[6][4]) {
+    // Row i of the matrix is m[i], m[4+i], m[8+i], m[12+i]
+    for (size_t p=0; p<6; ++p) {
+        size_t row = p/2;
+        float sign = (p%2 == 0) ? 1.0f : -1.0f;
+        for (size_t k=0; k<4; ++k) {
+            planes[p][k] = m[4*k+3] + sign*m[4*k+row];
+        }
+    }
+}
+
+bool boxInFrustum(const float planes[6][4], const float bmin[3], const float bmax[3]) {
+    for (size_t p=0; p<6; ++p) {
+        // The corner furthest along the plane normal
+        float x = planes[p][0] >= 0.0f ? bmax[0] : bmin[0];
+        float y = planes[p][1] >= 0.0f ? bmax[1] : bmin[1];
+        float z = planes[p][2] >= 0.0f ? bmax[2] : bmin[2];
+        if (planes[p][0]*x + planes[p][1]*y + planes[p][2]*z + planes[p][3] < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+/*
+  meshclusters.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef MESH_CLUSTERS_HEADER
+#define MESH_CLUSTERS_HEADER
+
+#include <vector>
+#include <cstddef>
+
+/*!
+  A run of triangles in cluster order and the box around them
+*/
+struct MeshCluster {
+    float bmin[3];
+    float bmax[3];
+    size_t first;
+    size_t count;
+};
+
+/*!
+  Sorts triangles along a Morton curve through their centroids and cuts the
+  result into clusters of cluster_size triangles, so each cluster covers a
+  compact region of space.  order receives the triangle numbers in cluster
+  order.  With indices, triangle t has corners indices[3t..3t+2] in
+  positions, otherwise corners 3t..3t+2.
+*/
+void buildClusters(const float *positions, const unsigned int *indices, size_t num_tris,
+                   size_t cluster_size, std::vector<unsigned int> &order,
+                   std::vector<MeshCluster> &clusters);
+
+/*!
+  Planes of the view frustum of a column major clip matrix, as (a,b,c,d)
+  with the inside where a*x + b*y + c*z + d >= 0
+*/
+void extractFrustum(const float clip[16], float planes[6][4]);
+
+// False when the box is entirely outside one of the planes
+bool boxInFrustum(const float planes[6][4], const float bmin[3], const float bmax[3]);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+  meshquantize.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cmath>
+#include <algorithm>
+
+#include "meshquantize.h"
+
+static const float SHORT_MAX = 32767.0f;
+static const float RAD_TO_DEG = 57.2957795f;
+
+void quantizeFrame(const float bmin[3], const float bmax[3], QuantizeFrame &frame) {
+    float extent = 0.0f;
+    for (size_t k=0; k<3; ++k) {
+        frame.center[k] = 0.5f*(bmin[k] + bmax[k]);
+        extent = std::max(extent, 0.5f*(bmax[k] - bmin[k]));
+    }
+    // Slightly larger than needed so rounding can't step past the end of the range
+    frame.scale = extent > 0.0f ? 1.0001f*extent/SHORT_MAX : 1.0f;
+}
+
+/*!
+  Signed bytes are decoded as (2c+1)/255, so this picks the c closest to x
+*/
+static inline signed char encodeByte(float x) {
+    float c = std::floor(0.5f*(255.0f*x - 1.0f) + 0.5f);
+    return (signed char)std::max(-128.0f, std::min(127.0f, c));
+}
+
+static inline float decodeByte(signed char c) {
+    return (2.0f*c + 1.0f)/255.0f;
+}
+
+void quantizeVertices(const QuantizeFrame &frame, const float *positions, const float *normals,
+                      size_t num_verts, short *qpositions, signed char *qnormals,
+                      QuantizeError &error) {
+    const float inv_scale = 1.0f/frame.scale;
+    float max_pos = error.position;
+    // Track the smallest cosine and convert to an angle once at the end
+    float min_cos = std::cos(error.normal/RAD_TO_DEG);
+
+#pragma omp parallel
+    {
+        float local_pos = 0.0f;
+        float local_cos = 1.0f;
+#pragma omp for nowait
+        for (long i=0; i<long(num_verts); ++i) {
+            const float *p = positions + 3*i;
+            const float *n = normals + 3*i;
+            short *qp = qpositions + 3*i;
+            signed char *qn = qnormals + 3*i;
+            float err2 = 0.0f;
+            float nn = 0.0f;
+            float nd = 0.0f;
+            float dd = 0.0f;
+            for (size_t k=0; k<3; ++k) {
+                float q = std::floor((p[k] - frame.center[k])*inv_scale + 0.5f);
+                qp[k] = (short)std::max(-SHORT_MAX, std::min(SHORT_MAX, q));
+                float d = frame.center[k] + frame.scale*qp[k] - p[k];
+                err2 += d*d;
+
+                qn[k] = encodeByte(n[k]);
+                float decoded = decodeByte(qn[k]);
+                nn += n[k]*n[k];
+                nd += n[k]*decoded;
+                dd += decoded*decoded;
+            }
+            local_pos = std::max(local_pos, err2);
+            // Zero normals stay zero, near enough, and don't count
+            if (nn > 0.0f) {
+                local_cos = std::min(local_cos, nd/std::sqrt(nn*dd));
+            }
+        }
+#pragma omp critical(quantize_error)
+        {
+            max_pos = std::max(max_pos, std::sqrt(local_pos));
+            min_cos = std::min(min_cos, local_cos);
+        }
+    }
+    error.position = max_pos;
+    error.normal = std::acos(std::max(-1.0f, std::min(1.0f, min_cos)))*RAD_TO_DEG;
+}
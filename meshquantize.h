@@ -0,0 +1,54 @@
+/*
+  meshquantize.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef MESH_QUANTIZE_HEADER
+#define MESH_QUANTIZE_HEADER
+
+#include <cstddef>
+
+/*!
+  Maps 16 bit positions back to model space: p = center + scale*q.
+  The scale is the same on every axis so the transform doesn't skew normals.
+*/
+struct QuantizeFrame {
+    float center[3];
+    float scale;
+};
+
+/*!
+  Largest error introduced so far, in model units for positions and in
+  degrees for normals
+*/
+struct QuantizeError {
+    float position;
+    float normal;
+};
+
+// Frame that fits the box from bmin to bmax into the range of a GLshort
+void quantizeFrame(const float bmin[3], const float bmax[3], QuantizeFrame &frame);
+
+/*!
+  Converts num_verts xyz positions to GLshorts in frame, and normals to
+  GLbytes as OpenGL decodes them.  The errors are raised to cover the new
+  vertices, so one QuantizeError can follow several calls.
+*/
+void quantizeVertices(const QuantizeFrame &frame, const float *positions, const float *normals,
+                      size_t num_verts, short *qpositions, signed char *qnormals,
+                      QuantizeError &error);
+
+#endif
@@ -0,0 +1,486 @@
+/*
+  meshsimplify.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+  The simplification is based on Fast Quadric Mesh Simplification,
+  https://github.com/sp4cerat/Fast-Quadric-Mesh-Simplification
+  which is distributed under this license:
+
+  Copyright (c) 2014 Sven Forstmann
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "meshsimplify.h"
+
+// Passes over the triangles before giving up on the target
+static const int MAX_PASSES = 100;
+// The references are rebuilt and deleted triangles dropped every few passes
+static const int REBUILD_INTERVAL = 5;
+// Higher collapses more per pass at some cost in quality
+static const double AGGRESSIVENESS = 7.0;
+// Neighbours may tilt this far (cosine) before a collapse is refused
+static const double MIN_NORMAL_DOT = 0.2;
+
+namespace {
+
+void addPlane(double q[10], const double n[3], double d) {
+    q[0] += n[0]*n[0]; q[1] += n[0]*n[1]; q[2] += n[0]*n[2]; q[3] += n[0]*d;
+    q[4] += n[1]*n[1]; q[5] += n[1]*n[2]; q[6] += n[1]*d;
+    q[7] += n[2]*n[2]; q[8] += n[2]*d;
+    q[9] += d*d;
+}
+
+// Determinant of the 3x3 matrix picked out of the quadric by index
+double det3(const double m[10], int a11, int a12, int a13, int a21, int a22, int a23,
+            int a31, int a32, int a33) {
+    return m[a11]*m[a22]*m[a33] + m[a13]*m[a21]*m[a32] + m[a12]*m[a23]*m[a31]
+        - m[a13]*m[a22]*m[a31] - m[a11]*m[a23]*m[a32] - m[a12]*m[a21]*m[a33];
+}
+
+// Sum of squared distances from p to the quadric's planes
+double quadricError(const double q[10], const double p[3]) {
+    double x = p[0], y = p[1], z = p[2];
+    return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x + q[4]*y*y
+        + 2*q[5]*y*z + 2*q[6]*y + q[7]*z*z + 2*q[8]*z + q[9];
+}
+
+bool normalize3(double v[3]) {
+    double len = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    if (len == 0.0) {
+        return false;
+    }
+    v[0] /= len;
+    v[1] /= len;
+    v[2] /= len;
+    return true;
+}
+
+void cross3(const double a[3], const double b[3], double res[3]) {
+    res[0] = a[1]*b[2] - a[2]*b[1];
+    res[1] = a[2]*b[0] - a[0]*b[2];
+    res[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+}
+
+MeshSimplifier::MeshSimplifier(const std::vector<float> &verts, const std::vector<unsigned int> &indices) :
+    scale2(0.0), maxError(0.0), prepared(false) {
+    vertices.resize(verts.size()/3);
+    double bmin[3] = {0.0, 0.0, 0.0};
+    double bmax[3] = {0.0, 0.0, 0.0};
+    for (size_t i=0; i<vertices.size(); ++i) {
+        for (size_t k=0; k<3; ++k) {
+            double c = verts[3*i+k];
+            vertices[i].p[k] = c;
+            bmin[k] = (i == 0) ? c : std::min(bmin[k], c);
+            bmax[k] = (i == 0) ? c : std::max(bmax[k], c);
+        }
+    }
+    double extent = std::max(bmax[0]-bmin[0], std::max(bmax[1]-bmin[1], bmax[2]-bmin[2]));
+    scale2 = extent*extent;
+
+    triangles.resize(indices.size()/3);
+    for (size_t i=0; i<triangles.size(); ++i) {
+        Triangle &t = triangles[i];
+        t.v[0] = indices[3*i];
+        t.v[1] = indices[3*i+1];
+        t.v[2] = indices[3*i+2];
+        t.deleted = false;
+        t.dirty = false;
+    }
+}
+
+size_t MeshSimplifier::getNumTris() const {
+    return triangles.size();
+}
+
+double MeshSimplifier::getMaxError() const {
+    return std::sqrt(maxError);
+}
+
+bool MeshSimplifier::simplify(size_t target_tris, volatile bool *cancel) {
+    size_t deleted_tris = 0;
+    std::vector<char> deleted0, deleted1;
+    const size_t start_tris = triangles.size();
+
+    for (int pass=0; pass<MAX_PASSES; ++pass) {
+        if (start_tris - deleted_tris <= target_tris) {
+            break;
+        }
+        if (cancel && *cancel) {
+            return false;
+        }
+        if (pass % REBUILD_INTERVAL == 0) {
+            updateMesh(!prepared);
+            if (pass == 0) {
+                // Earlier levels moved the vertices under the stored normals
+                updateNormals();
+            }
+            prepared = true;
+        }
+        for (size_t i=0; i<triangles.size(); ++i) {
+            triangles[i].dirty = false;
+        }
+
+        // Only edges this cheap are collapsed in this pass
+        double threshold = 1.0e-9*std::pow(double(pass+3), AGGRESSIVENESS)*scale2;
+
+        for (size_t i=0; i<triangles.size(); ++i) {
+            Triangle &t = triangles[i];
+            if (t.err[3] > threshold || t.deleted || t.dirty) {
+                continue;
+            }
+            for (int j=0; j<3; ++j) {
+                if (t.err[j] > threshold) {
+                    continue;
+                }
+                unsigned int i0 = t.v[j];
+                unsigned int i1 = t.v[(j+1)%3];
+                Vertex &v0 = vertices[i0];
+                const Vertex &v1 = vertices[i1];
+                if (v0.border != v1.border) {
+                    continue;
+                }
+
+                double p[3];
+                double err = edgeError(i0, i1, p);
+                deleted0.resize(v0.tcount);
+                deleted1.resize(v1.tcount);
+                if (flipped(p, i1, v0, deleted0) || flipped(p, i0, v1, deleted1)) {
+                    continue;
+                }
+
+                maxError = std::max(maxError, err);
+                std::memcpy(v0.p, p, sizeof(p));
+                for (int k=0; k<10; ++k) {
+                    v0.q.m[k] += v1.q.m[k];
+                }
+                size_t tstart = refs.size();
+                updateTriangles(i0, v0, deleted0, deleted_tris);
+                updateTriangles(i0, v1, deleted1, deleted_tris);
+                size_t tcount = refs.size() - tstart;
+                if (tcount <= v0.tcount) {
+                    // Reuse v0's old slot, the new references always fit
+                    if (tcount) {
+                        std::memmove(&refs[v0.tstart], &refs[tstart], tcount*sizeof(Ref));
+                    }
+                } else {
+                    v0.tstart = (unsigned int)tstart;
+                }
+                v0.tcount = (unsigned int)tcount;
+                break;
+            }
+            if (start_tris - deleted_tris <= target_tris) {
+                break;
+            }
+        }
+    }
+    compactMesh();
+    return true;
+}
+
+/*!
+  Rebuilds the vertex to triangle references.  The first time through it
+  also finds the open boundary and sets up the quadrics and edge errors,
+  which later levels keep.
+*/
+void MeshSimplifier::updateMesh(bool first) {
+    if (!first) {
+        size_t dst = 0;
+        for (size_t i=0; i<triangles.size(); ++i) {
+            if (!triangles[i].deleted) {
+                triangles[dst++] = triangles[i];
+            }
+        }
+        triangles.resize(dst);
+    }
+
+    for (size_t i=0; i<vertices.size(); ++i) {
+        vertices[i].tstart = 0;
+        vertices[i].tcount = 0;
+    }
+    for (size_t i=0; i<triangles.size(); ++i) {
+        for (int j=0; j<3; ++j) {
+            ++vertices[triangles[i].v[j]].tcount;
+        }
+    }
+    unsigned int tstart = 0;
+    for (size_t i=0; i<vertices.size(); ++i) {
+        vertices[i].tstart = tstart;
+        tstart += vertices[i].tcount;
+        vertices[i].tcount = 0;
+    }
+    refs.resize(3*triangles.size());
+    for (size_t i=0; i<triangles.size(); ++i) {
+        for (int j=0; j<3; ++j) {
+            Vertex &v = vertices[triangles[i].v[j]];
+            refs[v.tstart + v.tcount].tid = (unsigned int)i;
+            refs[v.tstart + v.tcount].tvertex = (unsigned int)j;
+            ++v.tcount;
+        }
+    }
+
+    if (!first) {
+        return;
+    }
+
+    // An edge used by only one triangle is on the boundary
+    std::vector<unsigned int> vcount, vids;
+    for (size_t i=0; i<vertices.size(); ++i) {
+        vertices[i].border = false;
+    }
+    for (size_t i=0; i<vertices.size(); ++i) {
+        const Vertex &v = vertices[i];
+        vcount.clear();
+        vids.clear();
+        for (unsigned int k=0; k<v.tcount; ++k) {
+            const Triangle &t = triangles[refs[v.tstart+k].tid];
+            for (int j=0; j<3; ++j) {
+                unsigned int id = t.v[j];
+                size_t ofs = std::find(vids.begin(), vids.end(), id) - vids.begin();
+                if (ofs == vids.size()) {
+                    vids.push_back(id);
+                    vcount.push_back(1);
+                } else {
+                    ++vcount[ofs];
+                }
+            }
+        }
+        for (size_t j=0; j<vcount.size(); ++j) {
+            if (vcount[j] == 1) {
+                vertices[vids[j]].border = true;
+            }
+        }
+    }
+
+    for (size_t i=0; i<vertices.size(); ++i) {
+        std::memset(vertices[i].q.m, 0, sizeof(vertices[i].q.m));
+    }
+    updateNormals();
+    for (size_t i=0; i<triangles.size(); ++i) {
+        Triangle &t = triangles[i];
+        const double *p0 = vertices[t.v[0]].p;
+        double d = -(t.n[0]*p0[0] + t.n[1]*p0[1] + t.n[2]*p0[2]);
+        for (int j=0; j<3; ++j) {
+            addPlane(vertices[t.v[j]].q.m, t.n, d);
+        }
+    }
+    for (size_t i=0; i<triangles.size(); ++i) {
+        Triangle &t = triangles[i];
+        double p[3];
+        for (int j=0; j<3; ++j) {
+            t.err[j] = edgeError(t.v[j], t.v[(j+1)%3], p);
+        }
+        t.err[3] = std::min(t.err[0], std::min(t.err[1], t.err[2]));
+    }
+}
+
+/*!
+  Recomputes the triangle normals the flip test compares against
+*/
+void MeshSimplifier::updateNormals() {
+    for (size_t i=0; i<triangles.size(); ++i) {
+        Triangle &t = triangles[i];
+        const double *p0 = vertices[t.v[0]].p;
+        const double *p1 = vertices[t.v[1]].p;
+        const double *p2 = vertices[t.v[2]].p;
+        double e1[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+        double e2[3] = {p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2]};
+        cross3(e1, e2, t.n);
+        normalize3(t.n);
+    }
+}
+
+/*!
+  Drops deleted triangles and unused vertices, keeping the quadrics and
+  boundary flags of the rest for the next level
+*/
+void MeshSimplifier::compactMesh() {
+    size_t dst = 0;
+    for (size_t i=0; i<vertices.size(); ++i) {
+        vertices[i].tcount = 0;
+    }
+    for (size_t i=0; i<triangles.size(); ++i) {
+        if (!triangles[i].deleted) {
+            Triangle &t = triangles[dst++];
+            t = triangles[i];
+            for (int j=0; j<3; ++j) {
+                vertices[t.v[j]].tcount = 1;
+            }
+        }
+    }
+    triangles.resize(dst);
+
+    dst = 0;
+    for (size_t i=0; i<vertices.size(); ++i) {
+        if (vertices[i].tcount) {
+            vertices[i].tstart = (unsigned int)dst;
+            vertices[dst].p[0] = vertices[i].p[0];
+            vertices[dst].p[1] = vertices[i].p[1];
+            vertices[dst].p[2] = vertices[i].p[2];
+            vertices[dst].q = vertices[i].q;
+            vertices[dst].border = vertices[i].border;
+            ++dst;
+        }
+    }
+    for (size_t i=0; i<triangles.size(); ++i) {
+        Triangle &t = triangles[i];
+        for (int j=0; j<3; ++j) {
+            t.v[j] = vertices[t.v[j]].tstart;
+        }
+    }
+    vertices.resize(dst);
+    refs.clear();
+}
+
+/*!
+  Error of collapsing the edge v1-v2, and the best place for the merged vertex.
+  When the optimal point can't be solved for, the better of the two ends
+  and the midpoint is used.
+*/
+double MeshSimplifier::edgeError(unsigned int id1, unsigned int id2, double p[3]) const {
+    const Vertex &v1 = vertices[id1];
+    const Vertex &v2 = vertices[id2];
+    double q[10];
+    for (int k=0; k<10; ++k) {
+        q[k] = v1.q.m[k] + v2.q.m[k];
+    }
+    bool border = v1.border && v2.border;
+    double det = det3(q, 0, 1, 2, 1, 4, 5, 2, 5, 7);
+    if (det != 0.0 && !border) {
+        // The point minimizing the quadric
+        p[0] = -1.0/det*det3(q, 1, 2, 3, 4, 5, 6, 5, 7, 8);
+        p[1] = 1.0/det*det3(q, 0, 2, 3, 1, 5, 6, 2, 7, 8);
+        p[2] = -1.0/det*det3(q, 0, 1, 3, 1, 4, 6, 2, 5, 8);
+        return quadricError(q, p);
+    }
+    double mid[3] = {0.5*(v1.p[0]+v2.p[0]), 0.5*(v1.p[1]+v2.p[1]), 0.5*(v1.p[2]+v2.p[2])};
+    double e1 = quadricError(q, v1.p);
+    double e2 = quadricError(q, v2.p);
+    double e3 = quadricError(q, mid);
+    double err = std::min(e1, std::min(e2, e3));
+    const double *best = (err == e1) ? v1.p : (err == e2) ? v2.p : mid;
+    std::memcpy(p, best, 3*sizeof(double));
+    return err;
+}
+
+/*!
+  True if moving v0 to p would flip or squash one of its triangles.
+  Marks the triangles shared with i1, which the collapse removes.
+*/
+bool MeshSimplifier::flipped(const double p[3], unsigned int i1, const Vertex &v0,
+                             std::vector<char> &deleted) const {
+    for (unsigned int k=0; k<v0.tcount; ++k) {
+        const Ref &r = refs[v0.tstart+k];
+        const Triangle &t = triangles[r.tid];
+        if (t.deleted) {
+            continue;
+        }
+        unsigned int id1 = t.v[(r.tvertex+1)%3];
+        unsigned int id2 = t.v[(r.tvertex+2)%3];
+        if (id1 == i1 || id2 == i1) {
+            deleted[k] = 1;
+            continue;
+        }
+        const double *p1 = vertices[id1].p;
+        const double *p2 = vertices[id2].p;
+        double d1[3] = {p1[0]-p[0], p1[1]-p[1], p1[2]-p[2]};
+        double d2[3] = {p2[0]-p[0], p2[1]-p[1], p2[2]-p[2]};
+        if (!normalize3(d1) || !normalize3(d2)) {
+            return true;
+        }
+        if (std::fabs(d1[0]*d2[0] + d1[1]*d2[1] + d1[2]*d2[2]) > 0.999) {
+            return true;
+        }
+        double n[3];
+        cross3(d1, d2, n);
+        normalize3(n);
+        deleted[k] = 0;
+        if (n[0]*t.n[0] + n[1]*t.n[1] + n[2]*t.n[2] < MIN_NORMAL_DOT) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+  Points v's triangles at i0, deleting the ones that collapse to a line
+*/
+void MeshSimplifier::updateTriangles(unsigned int i0, const Vertex &v, const std::vector<char> &deleted,
+                                     size_t &deleted_tris) {
+    double p[3];
+    for (unsigned int k=0; k<v.tcount; ++k) {
+        Ref r = refs[v.tstart+k];
+        Triangle &t = triangles[r.tid];
+        if (t.deleted) {
+            continue;
+        }
+        if (deleted[k]) {
+            t.deleted = true;
+            ++deleted_tris;
+            continue;
+        }
+        t.v[r.tvertex] = i0;
+        t.dirty = true;
+        for (int j=0; j<3; ++j) {
+            t.err[j] = edgeError(t.v[j], t.v[(j+1)%3], p);
+        }
+        t.err[3] = std::min(t.err[0], std::min(t.err[1], t.err[2]));
+        refs.push_back(r);
+    }
+}
+
+void MeshSimplifier::getTriangles(std::vector<float> &positions, std::vector<float> &normals) const {
+    positions.resize(9*triangles.size());
+    normals.resize(9*triangles.size());
+#pragma omp parallel for
+    for (long i=0; i<long(triangles.size()); ++i) {
+        const Triangle &t = triangles[i];
+        const double *p[3] = {vertices[t.v[0]].p, vertices[t.v[1]].p, vertices[t.v[2]].p};
+        double e1[3] = {p[1][0]-p[0][0], p[1][1]-p[0][1], p[1][2]-p[0][2]};
+        double e2[3] = {p[2][0]-p[0][0], p[2][1]-p[0][1], p[2][2]-p[0][2]};
+        double n[3];
+        cross3(e1, e2, n);
+        normalize3(n);
+        for (int j=0; j<3; ++j) {
+            for (int k=0; k<3; ++k) {
+                positions[9*i+3*j+k] = float(p[j][k]);
+                normals[9*i+3*j+k] = float(n[k]);
+            }
+        }
+    }
+}
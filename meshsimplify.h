@@ -0,0 +1,123 @@
+/*
+  meshsimplify.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+  The simplification is based on Fast Quadric Mesh Simplification,
+  https://github.com/sp4cerat/Fast-Quadric-Mesh-Simplification
+  which is distributed under this license:
+
+  Copyright (c) 2014 Sven Forstmann
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef MESH_SIMPLIFY_HEADER
+#define MESH_SIMPLIFY_HEADER
+
+#include <vector>
+#include <cstddef>
+
+/*!
+  Quadric error edge collapse decimation of a welded triangle mesh.
+
+  Rather than a priority queue of every edge, each pass collapses all edges
+  whose error is under a threshold that grows from pass to pass, which is
+  nearly as accurate and much faster on big meshes.  Collapses that would
+  flip a neighbouring triangle, or pull an open boundary inwards, are
+  skipped.
+
+  simplify() can be called repeatedly with smaller targets to produce a
+  chain of levels, each starting from the one before.  The quadrics are
+  built once from the full model and carried along, so errors are always
+  measured against the original surface.
+*/
+class MeshSimplifier {
+public:
+    // verts holds 3 floats per vertex, indices 3 per triangle
+    MeshSimplifier(const std::vector<float> &verts, const std::vector<unsigned int> &indices);
+
+    // Collapses edges until at most target_tris triangles remain, or no
+    // more can go.  Returns false if *cancel was set along the way.
+    bool simplify(size_t target_tris, volatile bool *cancel = 0);
+
+    size_t getNumTris() const;
+    // Bound on how far any vertex has moved off the planes of the original
+    // triangles it replaced, in model units.  It's the root of the summed
+    // squared distances, so it overestimates, but never underestimates.
+    double getMaxError() const;
+    // The current mesh as a triangle soup with face normals, 9 floats per triangle each
+    void getTriangles(std::vector<float> &positions, std::vector<float> &normals) const;
+
+private:
+    struct Quadric {
+        double m[10];
+    };
+    struct Vertex {
+        double p[3];
+        Quadric q;
+        unsigned int tstart;
+        unsigned int tcount;
+        bool border;
+    };
+    struct Triangle {
+        unsigned int v[3];
+        double err[4];
+        double n[3];
+        bool deleted;
+        bool dirty;
+    };
+    // Triangle tid uses the vertex as its corner tvertex
+    struct Ref {
+        unsigned int tid;
+        unsigned int tvertex;
+    };
+
+    void updateMesh(bool first);
+    void updateNormals();
+    void compactMesh();
+    double edgeError(unsigned int v1, unsigned int v2, double p[3]) const;
+    bool flipped(const double p[3], unsigned int i1, const Vertex &v0,
+                 std::vector<char> &deleted) const;
+    void updateTriangles(unsigned int i0, const Vertex &v, const std::vector<char> &deleted,
+                         size_t &deleted_tris);
+
+    std::vector<Vertex> vertices;
+    std::vector<Triangle> triangles;
+    std::vector<Ref> refs;
+    // Squared size of the model, so thresholds don't depend on its units
+    double scale2;
+    double maxError;
+    // Set once the quadrics have been built from the full model
+    bool prepared;
+};
+
+#endif
@@ -0,0 +1,188 @@
+/*
+  profiler.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "profiler.h"
+#include "fastfloat.h"
+
+// Spans kept for the trace, about 12 MB worth
+static const size_t MAX_PROFILE_EVENTS = 1<<19;
+// Weight of the newest time in the running averages
+static const double AVERAGE_WEIGHT = 0.1;
+
+namespace {
+
+/*!
+  A span on track 0 for the GPU, or track i for the i'th thread seen
+*/
+struct ProfileEvent {
+    const char *name;
+    qint64 start;
+    qint64 duration;
+    int track;
+};
+
+struct ProfileStat {
+    double lastMs;
+    double averageMs;
+    qint64 count;
+};
+
+QMutex profileMutex;
+QElapsedTimer profileClock;
+std::vector<ProfileEvent> events;
+size_t dropped = 0;
+// Keyed by name, with GPU spans kept apart from CPU spans of the same name
+std::map<std::pair<std::string, bool>, ProfileStat> stats;
+// Threads in the order they first recorded something; track i+1 is threads[i]
+std::vector<Qt::HANDLE> threads;
+std::vector<bool> guiThreads;
+
+}
+
+volatile bool Profiler::enabled = false;
+
+void Profiler::setEnabled(bool enable) {
+    QMutexLocker lock(&profileMutex);
+    if (enable && !profileClock.isValid()) {
+        profileClock.start();
+    }
+    enabled = enable;
+}
+
+qint64 Profiler::now() {
+    return profileClock.isValid() ? profileClock.nsecsElapsed() : 0;
+}
+
+void Profiler::record(const char *name, qint64 start, qint64 duration, bool gpu) {
+    QMutexLocker lock(&profileMutex);
+    int track = 0;
+    if (!gpu) {
+        Qt::HANDLE id = QThread::currentThreadId();
+        size_t i = 0;
+        while (i < threads.size() && threads[i] != id) {
+            ++i;
+        }
+        if (i == threads.size()) {
+            QCoreApplication *app = QCoreApplication::instance();
+            threads.push_back(id);
+            guiThreads.push_back(app && QThread::currentThread() == app->thread());
+        }
+        track = int(i) + 1;
+    }
+    if (events.size() < MAX_PROFILE_EVENTS) {
+        ProfileEvent event = {name, start, duration, track};
+        events.push_back(event);
+    } else {
+        ++dropped;
+    }
+
+    double ms = duration*1.0e-6;
+    std::map<std::pair<std::string, bool>, ProfileStat>::iterator it =
+        stats.find(std::make_pair(std::string(name), gpu));
+    if (it == stats.end()) {
+        ProfileStat stat = {ms, ms, 1};
+        stats[std::make_pair(std::string(name), gpu)] = stat;
+    } else {
+        it->second.lastMs = ms;
+        it->second.averageMs += AVERAGE_WEIGHT*(ms - it->second.averageMs);
+        ++it->second.count;
+    }
+}
+
+void Profiler::clear() {
+    QMutexLocker lock(&profileMutex);
+    std::vector<ProfileEvent>().swap(events);
+    dropped = 0;
+    stats.clear();
+}
+
+QStringList Profiler::summary() {
+    QMutexLocker lock(&profileMutex);
+    QStringList lines;
+    std::map<std::pair<std::string, bool>, ProfileStat>::const_iterator it;
+    for (it = stats.begin(); it != stats.end(); ++it) {
+        QString name = QString::fromLatin1(it->first.first.c_str());
+        if (it->first.second) {
+            name += QLatin1String(" (GPU)");
+        }
+        lines << QString("%1: %2 ms, average %3 ms, %4 times")
+            .arg(name).arg(it->second.lastMs, 0, 'f', 2)
+            .arg(it->second.averageMs, 0, 'f', 2).arg(it->second.count);
+    }
+    if (dropped > 0) {
+        lines << QString("%1 spans not kept for the trace").arg(dropped);
+    }
+    return lines;
+}
+
+size_t Profiler::numEvents() {
+    QMutexLocker lock(&profileMutex);
+    return events.size();
+}
+
+/*!
+  Complete ("X") events with microsecond times, plus metadata naming the tracks
+*/
+void Profiler::exportTrace(const char *fname) {
+    QMutexLocker lock(&profileMutex);
+    std::FILE *out = std::fopen(fname, "w");
+    if (!out) {
+        throw std::runtime_error(std::string("Could not open ") + fname + " for writing");
+    }
+    std::fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    std::fprintf(out, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0,"
+                 " \"args\": {\"name\": \"GPU\"}}");
+    for (size_t i=0; i<threads.size(); ++i) {
+        std::fprintf(out, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %lu,"
+                     " \"args\": {\"name\": ", (unsigned long)(i+1));
+        if (guiThreads[i]) {
+            std::fprintf(out, "\"GUI thread\"}}");
+        } else {
+            std::fprintf(out, "\"Thread %lu\"}}", (unsigned long)(i+1));
+        }
+    }
+    char ts[64];
+    char dur[64];
+    for (size_t i=0; i<events.size(); ++i) {
+        const ProfileEvent &e = events[i];
+        // The GUI runs under the user's locale, which could make %f write "1,5"
+        format_float(ts, "%.3f", e.start*1.0e-3);
+        format_float(dur, "%.3f", e.duration*1.0e-3);
+        // Names are string literals in the code, so they need no escaping
+        std::fprintf(out, ",\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1,"
+                     " \"tid\": %d, \"ts\": %s, \"dur\": %s}",
+                     e.name, e.track == 0 ? "gpu" : "cpu", e.track, ts, dur);
+    }
+    std::fprintf(out, "\n]}\n");
+    bool failed = std::ferror(out) != 0;
+    if (std::fclose(out) != 0 || failed) {
+        throw std::runtime_error(std::string("Could not write ") + fname);
+    }
+}
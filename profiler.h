@@ -0,0 +1,77 @@
+/*
+  profiler.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef PROFILER_HEADER
+#define PROFILER_HEADER
+
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <cstddef>
+
+/*!
+  Collects timed spans from scoped timers on any thread, for the viewer's
+  overlay and for export as a Chrome trace (chrome://tracing or Perfetto).
+  Everything is static so code anywhere can time itself.  While disabled a
+  scope costs one test of a flag.
+*/
+class Profiler {
+public:
+    static bool isEnabled() {
+        return enabled;
+    }
+    // Turning it on for the first time starts the clock
+    static void setEnabled(bool enable);
+
+    // Nanoseconds since the clock started
+    static qint64 now();
+    // Adds a span.  GPU spans go on their own track of the trace.
+    static void record(const char *name, qint64 start, qint64 duration, bool gpu);
+    static void clear();
+
+    // One line per span name with the last time, a running average and the count
+    static QStringList summary();
+    // Spans kept for the trace.  Past a limit new ones only update the summary.
+    static size_t numEvents();
+    // Writes the spans in the Chrome trace event format, throws std::runtime_error on failure
+    static void exportTrace(const char *fname);
+
+private:
+    static volatile bool enabled;
+};
+
+/*!
+  Times the CPU from construction to destruction
+*/
+class ProfileScope {
+public:
+    ProfileScope(const char *name) : name(name), start(Profiler::isEnabled() ? Profiler::now() : -1) {
+    }
+    ~ProfileScope() {
+        if (start >= 0) {
+            Profiler::record(name, start, Profiler::now() - start, false);
+        }
+    }
+
+private:
+    const char *name;
+    qint64 start;
+};
+
+#endif
@@ -0,0 +1,229 @@
+/*
+  scenesetup.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifdef __APPLE_CC__
+#include <OpenGL/glu.h>
+#else
+#include <GL/glu.h>
+#endif
+
+#include <cmath>
+#include <algorithm>
+
+#include "scenesetup.h"
+
+// out = a*b, all column major
+static void multiply(const float a[16], const float b[16], float out[16]) {
+    for (size_t col=0; col<4; ++col) {
+        for (size_t row=0; row<4; ++row) {
+            out[4*col+row] = a[row]*b[4*col] + a[4+row]*b[4*col+1] +
+                a[8+row]*b[4*col+2] + a[12+row]*b[4*col+3];
+        }
+    }
+}
+
+// Multiplies m by a rotation of degrees around an axis, like glRotatef
+static void rotate(float m[16], float degrees, size_t axis) {
+    const float radians = degrees*3.14159265f/180.0f;
+    const float c = std::cos(radians);
+    const float s = std::sin(radians);
+    const size_t i = (axis+1)%3;
+    const size_t j = (axis+2)%3;
+    float r[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+    r[4*i+i] = c;
+    r[4*i+j] = s;
+    r[4*j+i] = -s;
+    r[4*j+j] = c;
+    float out[16];
+    multiply(m, r, out);
+    std::copy(out, out+16, m);
+}
+
+/*!
+  Loads the material and light arrays
+*/
+SceneSetup::SceneSetup() {
+    // lines
+    mat_specular[LINE_MAT][0]=0.0f;
+    mat_specular[LINE_MAT][1]=0.0f;
+    mat_specular[LINE_MAT][2]=0.0f;
+    mat_specular[LINE_MAT][3]=1.0f;
+  
+    mat_shininess[LINE_MAT][0]=80.0f;
+
+    mat_diffuse[LINE_MAT][0]=0.0f;
+    mat_diffuse[LINE_MAT][1]=0.0f;
+    mat_diffuse[LINE_MAT][2]=0.0f;
+    mat_diffuse[LINE_MAT][3]=1.0f;
+  
+    mat_ambient[LINE_MAT][0] = 0.0f;
+    mat_ambient[LINE_MAT][1] = 0.0f;
+    mat_ambient[LINE_MAT][2] = 0.0f;
+    mat_ambient[LINE_MAT][3] = 1.0f;
+
+    // closed spots
+    mat_specular[SURF_MAT][0]=1.0f;
+    mat_specular[SURF_MAT][1]=1.0f;
+    mat_specular[SURF_MAT][2]=1.0f;
+    mat_specular[SURF_MAT][3]=1.0f;
+
+    mat_shininess[SURF_MAT][0]=100.0f;
+  
+    mat_diffuse[SURF_MAT][0]=0.0f;
+    mat_diffuse[SURF_MAT][1]=0.0f;
+    mat_diffuse[SURF_MAT][2]=1.0f;
+    mat_diffuse[SURF_MAT][3]=1.0f;
+  
+    mat_ambient[SURF_MAT][0] = 0.10f;
+    mat_ambient[SURF_MAT][1] = 0.10f;
+    mat_ambient[SURF_MAT][2] = 0.10f;
+    mat_ambient[SURF_MAT][3] = 1.0f;
+
+    light_position[0][0]=0.0f;
+    light_position[0][1]=0.0f;
+    light_position[0][2]=30.0f;
+    light_position[0][3]=1.0f;
+  
+    light_position[1][0]=0.0f;
+    light_position[1][1]=0.0f;
+    light_position[1][2]=-30.0f;
+    light_position[1][3]=1.0f;
+  
+    for (size_t i=0;i<NUM_LIGHTS; ++i) {
+        light_color[i][0]=1.0f;
+        light_color[i][1]=1.0f;
+        light_color[i][2]=1.0f;
+        light_color[i][3]=1.0f;
+        lmodel_ambient[i][0]=0.4f;
+        lmodel_ambient[i][1]=0.4f;
+        lmodel_ambient[i][2]=0.4f;
+        lmodel_ambient[i][3]=1.0f;
+    }
+}
+
+void SceneSetup::initGL() {
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+  
+    glShadeModel(GL_SMOOTH);
+    
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    // Push filled polygons back a little so the facet outlines win the depth test
+    glPolygonOffset(1.0, 1.0);
+    
+    glEnable(GL_DEPTH_TEST);
+    
+    glEnable(GL_LINE_SMOOTH);
+    
+    glEnable(GL_BLEND);
+
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+    glEnable(GL_LIGHT1);
+}
+
+void SceneSetup::setProjection(int width, int height) {
+    glViewport(0,0, (GLsizei) width, (GLsizei)height);
+  
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(FIELD_OF_VIEW, 1.0, NEAR_PLANE, FAR_PLANE);
+    
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+}
+
+void SceneSetup::applyCamera(float translate, float rotationX, float rotationY, float rotationZ,
+                             const float center[3]) {
+    glTranslatef(0.0,0.0,-translate);
+    glRotatef(rotationX, 1.0, 0.0, 0.0);
+    glRotatef(rotationY, 0.0, 1.0, 0.0);
+    glRotatef(rotationZ, 0.0, 0.0, 1.0);
+    glTranslatef(-center[0], -center[1], -center[2]);
+}
+
+void SceneSetup::placeLights(float minz, const float center[3]) {
+    light_position[0][0]=center[0] + 2.0*minz;
+    light_position[0][1]=center[1] + 2.0*minz;
+    light_position[0][2]=center[2] + 2.0*minz;
+        
+    light_position[1][0]=center[0] + 2.0*minz;
+    light_position[1][1]=center[1] + 2.0*minz;
+    light_position[1][2]=center[2] - 2.0*minz;
+}
+
+void SceneSetup::applyLights() {
+    glLightfv(GL_LIGHT0, GL_POSITION, light_position[0]);
+    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_color[0]);
+    glLightfv(GL_LIGHT0, GL_SPECULAR, light_color[0]);
+  
+    glLightfv(GL_LIGHT1, GL_POSITION, light_position[1]);
+    glLightfv(GL_LIGHT1, GL_DIFFUSE, light_color[1]);
+    glLightfv(GL_LIGHT1, GL_SPECULAR, light_color[1]);
+  
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, lmodel_ambient[0]);
+}
+
+void SceneSetup::useMaterial(size_t mat) {
+    glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat_diffuse[mat]);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, mat_specular[mat]);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, mat_shininess[mat]);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, mat_ambient[mat]);
+}
+
+void SceneSetup::rasterLighting(size_t mat, RasterLighting &lighting) const {
+    for (size_t k=0; k<3; ++k) {
+        lighting.scene_ambient[k] = lmodel_ambient[0][k];
+        lighting.mat_ambient[k] = mat_ambient[mat][k];
+        lighting.mat_diffuse[k] = mat_diffuse[mat][k];
+        lighting.mat_specular[k] = mat_specular[mat][k];
+    }
+    lighting.shininess = mat_shininess[mat][0];
+    lighting.num_lights = NUM_LIGHTS;
+    for (size_t i=0; i<NUM_LIGHTS; ++i) {
+        for (size_t k=0; k<3; ++k) {
+            lighting.lights[i].position[k] = light_position[i][k];
+            lighting.lights[i].diffuse[k] = light_color[i][k];
+            lighting.lights[i].specular[k] = light_color[i][k];
+        }
+    }
+}
+
+void SceneSetup::cameraMatrix(float translate, float rotationX, float rotationY, float rotationZ,
+                              const float center[3], float clip[16]) {
+    // gluPerspective with an aspect ratio of 1, as in setProjection
+    const float f = 1.0f/std::tan(float(FIELD_OF_VIEW)*3.14159265f/360.0f);
+    const float n = float(NEAR_PLANE);
+    const float r = float(FAR_PLANE);
+    const float proj[16] = {f,0,0,0, 0,f,0,0, 0,0,(r+n)/(n-r),-1, 0,0,2*r*n/(n-r),0};
+    const float view[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,-translate,1};
+    multiply(proj, view, clip);
+    rotate(clip, rotationX, 0);
+    rotate(clip, rotationY, 1);
+    rotate(clip, rotationZ, 2);
+    const float recenter[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, -center[0],-center[1],-center[2],1};
+    float out[16];
+    multiply(clip, recenter, out);
+    std::copy(out, out+16, clip);
+}
+
+float SceneSetup::minimumZoom(float boundingRadius) {
+    // The radius is exact, so leave some room around the sphere
+    return 1.375f*boundingRadius;
+}
@@ -0,0 +1,87 @@
+/*
+  scenesetup.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SCENE_SETUP_HEADER
+#define SCENE_SETUP_HEADER
+
+#include <QtOpenGL>
+
+#ifdef __APPLE_CC__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include <cstddef>
+
+#include "softrasterizer.h"
+
+static const size_t NUM_MATERIALS=2;
+static const size_t NUM_LIGHTS=2;
+static const size_t LINE_MAT=0;
+static const size_t SURF_MAT=1;
+// Perspective projection set up by setProjection
+static const double FIELD_OF_VIEW=80.0;
+static const double NEAR_PLANE=1.0;
+static const double FAR_PLANE=1000.0;
+// View direction that resetView goes back to
+static const float DEFAULT_ROTATION_X=27.2457f;
+static const float DEFAULT_ROTATION_Y=-46.44f;
+
+/*!
+  Lights, materials and camera shared by everything that draws a model,
+  so the on screen viewer and offscreen renderers look the same
+*/
+class SceneSetup {
+public:
+    SceneSetup();
+
+    // Enables the OpenGL state everything is drawn with
+    void initGL();
+    void setProjection(int width, int height);
+    // Multiplies in the camera, looking at center from distance translate
+    void applyCamera(float translate, float rotationX, float rotationY, float rotationZ,
+                     const float center[3]);
+    // Puts the lights outside a model around center that fits in minz
+    void placeLights(float minz, const float center[3]);
+    void applyLights();
+    void useMaterial(size_t mat);
+    // The lights and material mat for drawing without OpenGL
+    void rasterLighting(size_t mat, RasterLighting &lighting) const;
+
+    // The matrix setProjection and applyCamera build, for drawing without OpenGL
+    static void cameraMatrix(float translate, float rotationX, float rotationY, float rotationZ,
+                             const float center[3], float clip[16]);
+
+    // Closest the camera can get to a model with this bounding radius
+    static float minimumZoom(float boundingRadius);
+
+private:
+    // Arrays to hold material properties
+    GLfloat mat_specular[NUM_MATERIALS][4];
+    GLfloat mat_shininess[NUM_MATERIALS][1];
+    GLfloat mat_diffuse[NUM_MATERIALS][4];
+    GLfloat mat_ambient[NUM_MATERIALS][4];
+
+    // Arrays to hold light properties
+    GLfloat light_position[NUM_LIGHTS][4];
+    GLfloat light_color[NUM_LIGHTS][4];
+    GLfloat lmodel_ambient[NUM_LIGHTS][4];
+};
+
+#endif
@@ -0,0 +1,427 @@
+/*
+  softrasterizer.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cmath>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "softrasterizer.h"
+
+// Tiles are square, small enough to spread across cores and stay in cache
+static const int TILE_SIZE = 64;
+
+// Marks bin entries that index the clipped list rather than the caller's triangles
+static const unsigned int CLIPPED_BIT = 0x80000000u;
+
+static inline void transform(const float clip[16], const float *p, float out[4]) {
+    for (size_t r=0; r<4; ++r) {
+        out[r] = clip[r]*p[0] + clip[4+r]*p[1] + clip[8+r]*p[2] + clip[12+r];
+    }
+}
+
+/*!
+  Maps a clip space corner onto a width by height screen with y down and
+  depth in [0,1].
+*/
+static inline void toScreen(const float c[4], float width, float height, ScreenVertex &v) {
+    v.inv_w = 1.0f/c[3];
+    v.x = (0.5f + 0.5f*c[0]*v.inv_w)*width;
+    v.y = (0.5f - 0.5f*c[1]*v.inv_w)*height;
+    v.z = 0.5f + 0.5f*c[2]*v.inv_w;
+}
+
+/*!
+  Projects a corner onto the screen.  Returns false for corners at or
+  behind the eye.
+*/
+static inline bool project(const float clip[16], const float *p, float width, float height,
+                           ScreenVertex &v) {
+    float c[4];
+    transform(clip, p, c);
+    if (c[3] <= 1.0e-6f) {
+        return false;
+    }
+    toScreen(c, width, height, v);
+    return true;
+}
+
+// floor and ceil to int without a library call, for values well inside int range
+static inline int floorInt(float x) {
+    int i = int(x);
+    return i - (x < float(i) ? 1 : 0);
+}
+
+static inline int ceilInt(float x) {
+    int i = int(x);
+    return i + (x > float(i) ? 1 : 0);
+}
+
+// x to a whole power by repeated squaring, much cheaper than std::pow
+static inline float powInt(float x, unsigned int n) {
+    float result = 1.0f;
+    while (n) {
+        if (n & 1) {
+            result *= x;
+        }
+        x *= x;
+        n >>= 1;
+    }
+    return result;
+}
+
+static inline float dot3(const float *a, const float *b) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+/*!
+  Fixed function lighting at one vertex.  Normals are used as given, like
+  OpenGL without GL_NORMALIZE.
+*/
+static inline void shade(const RasterLighting &lighting, const float *p, const float *n, float rgb[3]) {
+    for (size_t k=0; k<3; ++k) {
+        rgb[k] = lighting.scene_ambient[k]*lighting.mat_ambient[k];
+    }
+    for (size_t i=0; i<lighting.num_lights; ++i) {
+        const RasterLight &light = lighting.lights[i];
+        float l[3] = {light.position[0] - p[0], light.position[1] - p[1], light.position[2] - p[2]};
+        float len = std::sqrt(dot3(l, l));
+        if (len > 0.0f) {
+            l[0] /= len;
+            l[1] /= len;
+            l[2] /= len;
+        }
+        float ndl = dot3(n, l);
+        if (ndl <= 0.0f) {
+            continue;
+        }
+        // Half way between the light and a viewer looking down -z
+        float hv[3] = {l[0], l[1], l[2] + 1.0f};
+        float hlen = std::sqrt(dot3(hv, hv));
+        float ndh = hlen > 0.0f ? dot3(n, hv)/hlen : 0.0f;
+        float spec = 0.0f;
+        if (ndh > 0.0f) {
+            // Shininess is nearly always a whole number
+            float whole = std::floor(lighting.shininess);
+            spec = whole == lighting.shininess ? powInt(ndh, (unsigned int)whole) :
+                std::pow(ndh, lighting.shininess);
+        }
+        for (size_t k=0; k<3; ++k) {
+            rgb[k] += ndl*lighting.mat_diffuse[k]*light.diffuse[k] +
+                spec*lighting.mat_specular[k]*light.specular[k];
+        }
+    }
+    for (size_t k=0; k<3; ++k) {
+        rgb[k] = std::min(1.0f, rgb[k]);
+    }
+}
+
+SoftRasterizer::SoftRasterizer() : w(0), h(0), tilesX(0), tilesY(0), numBinSets(0) {
+}
+
+void SoftRasterizer::resize(int width, int height) {
+    w = std::max(width, 0);
+    h = std::max(height, 0);
+    tilesX = (w + TILE_SIZE - 1)/TILE_SIZE;
+    tilesY = (h + TILE_SIZE - 1)/TILE_SIZE;
+    color.resize(size_t(w)*h);
+    depth.resize(size_t(w)*h);
+}
+
+void SoftRasterizer::clear(unsigned int argb) {
+    std::fill(color.begin(), color.end(), argb);
+    std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+int SoftRasterizer::width() const {
+    return w;
+}
+
+int SoftRasterizer::height() const {
+    return h;
+}
+
+const unsigned int *SoftRasterizer::pixels() const {
+    return color.empty() ? 0 : &color[0];
+}
+
+void SoftRasterizer::draw(const float *positions, const float *normals, size_t num_tris,
+                          const float clip[16], const RasterLighting &lighting) {
+    const size_t numTiles = size_t(tilesX)*tilesY;
+    if (numTiles == 0 || num_tris == 0) {
+        return;
+    }
+    numBinSets = 1;
+#ifdef _OPENMP
+    numBinSets = omp_get_max_threads();
+#endif
+    bins.resize(numBinSets*numTiles);
+    for (size_t i=0; i<bins.size(); ++i) {
+        bins[i].clear();
+    }
+    clipped.resize(numBinSets);
+    for (size_t i=0; i<clipped.size(); ++i) {
+        clipped[i].clear();
+    }
+
+    // Bin each triangle into every tile its screen box touches
+    const float fw = float(w);
+    const float fh = float(h);
+#pragma omp parallel
+    {
+        size_t thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        std::vector<unsigned int> *mine = &bins[thread*numTiles];
+        std::vector<ClippedTriangle> &mineClipped = clipped[thread];
+#pragma omp for schedule(static)
+        for (long t=0; t<long(num_tris); ++t) {
+            const float *p = positions + 9*t;
+            ScreenVertex v[3];
+            if (!project(clip, p, fw, fh, v[0]) || !project(clip, p+3, fw, fh, v[1]) ||
+                !project(clip, p+6, fw, fh, v[2])) {
+                // Rare, so cut it against the near plane here and keep the pieces
+                size_t first = mineClipped.size();
+                clipNear(clip, p, normals + 9*t, fw, fh, lighting, mineClipped);
+                for (size_t c=first; c<mineClipped.size(); ++c) {
+                    binTriangle(mineClipped[c].v, (unsigned int)c | CLIPPED_BIT, mine);
+                }
+                continue;
+            }
+            binTriangle(v, (unsigned int)t, mine);
+        }
+    }
+
+    // Tiles cover separate pixels, so they can be shaded in any order
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long tile=0; tile<long(numTiles); ++tile) {
+        drawTile(size_t(tile), positions, normals, clip, lighting);
+    }
+}
+
+/*!
+  Adds triangle id to the bins of every tile whose pixel centers its
+  screen box covers.
+*/
+void SoftRasterizer::binTriangle(const ScreenVertex v[3], unsigned int id,
+                                 std::vector<unsigned int> *tileBins) const {
+    float area = (v[1].x - v[0].x)*(v[2].y - v[0].y) - (v[1].y - v[0].y)*(v[2].x - v[0].x);
+    if (area == 0.0f || std::min(v[0].z, std::min(v[1].z, v[2].z)) > 1.0f ||
+        std::max(v[0].z, std::max(v[1].z, v[2].z)) < 0.0f) {
+        return;
+    }
+    float minX = std::min(v[0].x, std::min(v[1].x, v[2].x));
+    float maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+    float minY = std::min(v[0].y, std::min(v[1].y, v[2].y));
+    float maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+    if (maxX < 0.0f || maxY < 0.0f || minX > float(w) || minY > float(h)) {
+        return;
+    }
+    // Pixels are sampled at their centers, so tiny triangles can miss them all
+    int px0 = std::max(0, ceilInt(minX - 0.5f));
+    int px1 = std::min(w-1, floorInt(maxX - 0.5f));
+    int py0 = std::max(0, ceilInt(minY - 0.5f));
+    int py1 = std::min(h-1, floorInt(maxY - 0.5f));
+    if (px0 > px1 || py0 > py1) {
+        return;
+    }
+    int tx0 = px0/TILE_SIZE;
+    int tx1 = px1/TILE_SIZE;
+    int ty0 = py0/TILE_SIZE;
+    int ty1 = py1/TILE_SIZE;
+    for (int ty=ty0; ty<=ty1; ++ty) {
+        for (int tx=tx0; tx<=tx1; ++tx) {
+            tileBins[ty*tilesX + tx].push_back(id);
+        }
+    }
+}
+
+/*!
+  Cuts a triangle against the near plane, as OpenGL does, and appends the
+  zero, one or two triangles left in front of it.  Colors are lit at the
+  original corners and interpolated to the new ones.
+*/
+void SoftRasterizer::clipNear(const float clip[16], const float *p, const float *n,
+                              float fw, float fh, const RasterLighting &lighting,
+                              std::vector<ClippedTriangle> &out) {
+    float c[3][4];
+    float rgb[3][3];
+    float dist[3];
+    for (size_t k=0; k<3; ++k) {
+        transform(clip, p + 3*k, c[k]);
+        shade(lighting, p + 3*k, n + 3*k, rgb[k]);
+        // Positive in front of the near plane, where z >= -w
+        dist[k] = c[k][2] + c[k][3];
+    }
+
+    // Sutherland-Hodgman against one plane leaves at most four corners
+    float poly[4][4];
+    float polyRgb[4][3];
+    size_t count = 0;
+    for (size_t k=0; k<3; ++k) {
+        size_t next = (k+1)%3;
+        if (dist[k] >= 0.0f) {
+            std::copy(c[k], c[k] + 4, poly[count]);
+            std::copy(rgb[k], rgb[k] + 3, polyRgb[count]);
+            ++count;
+        }
+        if ((dist[k] >= 0.0f) != (dist[next] >= 0.0f)) {
+            float s = dist[k]/(dist[k] - dist[next]);
+            for (size_t i=0; i<4; ++i) {
+                poly[count][i] = c[k][i] + s*(c[next][i] - c[k][i]);
+            }
+            for (size_t i=0; i<3; ++i) {
+                polyRgb[count][i] = rgb[k][i] + s*(rgb[next][i] - rgb[k][i]);
+            }
+            ++count;
+        }
+    }
+
+    for (size_t i=1; i+1<count; ++i) {
+        const size_t corners[3] = {0, i, i+1};
+        ClippedTriangle tri;
+        bool visible = true;
+        for (size_t k=0; k<3; ++k) {
+            const float *pc = poly[corners[k]];
+            if (pc[3] <= 1.0e-6f) {
+                visible = false;
+                break;
+            }
+            toScreen(pc, fw, fh, tri.v[k]);
+            std::copy(polyRgb[corners[k]], polyRgb[corners[k]] + 3, tri.rgb[k]);
+        }
+        if (visible) {
+            out.push_back(tri);
+        }
+    }
+}
+
+/*!
+  Fills the pixels of one triangle that fall between (x0, y0) and (x1, y1),
+  testing and writing depth.
+*/
+static void fillTriangle(const ScreenVertex v[3], const float lit[3][3],
+                         int x0, int y0, int x1, int y1,
+                         int w, unsigned int *color, float *depth) {
+    float area = (v[1].x - v[0].x)*(v[2].y - v[0].y) - (v[1].y - v[0].y)*(v[2].x - v[0].x);
+    float inv_area = 1.0f/area;
+
+    // Pixels whose centers are inside the triangle's box
+    float minX = std::max(float(x0), std::min(v[0].x, std::min(v[1].x, v[2].x)));
+    float maxX = std::min(float(x1), std::max(v[0].x, std::max(v[1].x, v[2].x)));
+    float minY = std::max(float(y0), std::min(v[0].y, std::min(v[1].y, v[2].y)));
+    float maxY = std::min(float(y1), std::max(v[0].y, std::max(v[1].y, v[2].y)));
+    int px0 = std::max(x0, ceilInt(minX - 0.5f));
+    int px1 = std::min(x1, floorInt(maxX - 0.5f) + 1);
+    int py0 = std::max(y0, ceilInt(minY - 0.5f));
+    int py1 = std::min(y1, floorInt(maxY - 0.5f) + 1);
+    if (px0 >= px1 || py0 >= py1) {
+        return;
+    }
+
+    // Edge function k is the barycentric weight of corner k, scaled
+    // by 1/area so it's positive inside whichever way the triangle winds.
+    // They're taken relative to corner 0, because the absolute constant
+    // terms cancel badly for pixel sized triangles far from the origin.
+    float ea[3], eb[3], ec[3];
+    for (size_t k=0; k<3; ++k) {
+        const ScreenVertex &s = v[(k+1)%3];
+        const ScreenVertex &e = v[(k+2)%3];
+        ea[k] = (s.y - e.y)*inv_area;
+        eb[k] = (e.x - s.x)*inv_area;
+        ec[k] = ((s.x - v[0].x)*(e.y - v[0].y) - (s.y - v[0].y)*(e.x - v[0].x))*inv_area;
+    }
+
+    // Lit colors, premultiplied by 1/w for perspective correct interpolation
+    float rgb[3][3];
+    for (size_t k=0; k<3; ++k) {
+        for (size_t c=0; c<3; ++c) {
+            rgb[k][c] = lit[k][c]*v[k].inv_w;
+        }
+    }
+
+    for (int y=py0; y<py1; ++y) {
+        const float fy = y + 0.5f - v[0].y;
+        unsigned int *crow = &color[size_t(y)*w];
+        float *drow = &depth[size_t(y)*w];
+        for (int x=px0; x<px1; ++x) {
+            const float fx = x + 0.5f - v[0].x;
+            float b0 = ea[0]*fx + eb[0]*fy + ec[0];
+            float b1 = ea[1]*fx + eb[1]*fy + ec[1];
+            float b2 = ea[2]*fx + eb[2]*fy + ec[2];
+            float z = b0*v[0].z + b1*v[1].z + b2*v[2].z;
+            bool inside = (b0 >= 0.0f) & (b1 >= 0.0f) & (b2 >= 0.0f) &
+                (z >= 0.0f) & (z < drow[x]);
+            if (!inside) {
+                continue;
+            }
+            float iw = 1.0f/(b0*v[0].inv_w + b1*v[1].inv_w + b2*v[2].inv_w);
+            unsigned int out = 0xff000000u;
+            for (size_t c=0; c<3; ++c) {
+                float val = (b0*rgb[0][c] + b1*rgb[1][c] + b2*rgb[2][c])*iw;
+                int level = int(val*255.0f + 0.5f);
+                level = std::max(0, std::min(255, level));
+                out |= (unsigned int)level << (16 - 8*c);
+            }
+            drow[x] = z;
+            crow[x] = out;
+        }
+    }
+}
+
+/*!
+  Rasterizes the triangles binned into one tile.  Corners are projected and
+  lit again here rather than stored, which keeps memory flat for big models.
+*/
+void SoftRasterizer::drawTile(size_t tile, const float *positions, const float *normals,
+                              const float clip[16], const RasterLighting &lighting) {
+    const size_t numTiles = size_t(tilesX)*tilesY;
+    const int x0 = int(tile % tilesX)*TILE_SIZE;
+    const int y0 = int(tile / tilesX)*TILE_SIZE;
+    const int x1 = std::min(x0 + TILE_SIZE, w);
+    const int y1 = std::min(y0 + TILE_SIZE, h);
+    const float fw = float(w);
+    const float fh = float(h);
+
+    for (size_t set=0; set<numBinSets; ++set) {
+        const std::vector<unsigned int> &bin = bins[set*numTiles + tile];
+        for (size_t b=0; b<bin.size(); ++b) {
+            if (bin[b] & CLIPPED_BIT) {
+                const ClippedTriangle &tri = clipped[set][bin[b] & ~CLIPPED_BIT];
+                fillTriangle(tri.v, tri.rgb, x0, y0, x1, y1, w, &color[0], &depth[0]);
+                continue;
+            }
+            const size_t t = bin[b];
+            const float *p = positions + 9*t;
+            const float *n = normals + 9*t;
+            ScreenVertex v[3];
+            if (!project(clip, p, fw, fh, v[0]) || !project(clip, p+3, fw, fh, v[1]) ||
+                !project(clip, p+6, fw, fh, v[2])) {
+                continue;
+            }
+            float rgb[3][3];
+            for (size_t k=0; k<3; ++k) {
+                shade(lighting, p + 3*k, n + 3*k, rgb[k]);
+            }
+            fillTriangle(v, rgb, x0, y0, x1, y1, w, &color[0], &depth[0]);
+        }
+    }
+}
@@ -0,0 +1,116 @@
+/*
+  softrasterizer.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SOFT_RASTERIZER_HEADER
+#define SOFT_RASTERIZER_HEADER
+
+#include <vector>
+#include <cstddef>
+
+/*!
+  A point light, with OpenGL's default of no ambient term
+*/
+struct RasterLight {
+    float position[3];
+    float diffuse[3];
+    float specular[3];
+};
+
+/*!
+  The fixed function lighting model: a global ambient term plus Blinn-Phong
+  point lights, evaluated at each vertex with an infinitely distant viewer
+  looking down -z, as OpenGL does by default
+*/
+struct RasterLighting {
+    float scene_ambient[3];
+    float mat_ambient[3];
+    float mat_diffuse[3];
+    float mat_specular[3];
+    float shininess;
+    RasterLight lights[2];
+    size_t num_lights;
+};
+
+/*!
+  Corner of a triangle in screen space, with 1/w for perspective correct colors
+*/
+struct ScreenVertex {
+    float x;
+    float y;
+    float z;
+    float inv_w;
+};
+
+/*!
+  A triangle cut by the near plane, kept with its corners already projected
+  and lit because it no longer matches the caller's arrays
+*/
+struct ClippedTriangle {
+    ScreenVertex v[3];
+    float rgb[3][3];
+};
+
+/*!
+  Draws triangles into a 32 bit color buffer without OpenGL.
+
+  The screen is cut into tiles.  Triangles are first binned into the tiles
+  they touch, then the tiles are shaded in parallel, each with its own part
+  of the color and depth buffers, so no locking is needed.  Pixels are
+  tested with edge functions a row at a time, and colors are interpolated
+  perspective correctly between the lit vertices.
+*/
+class SoftRasterizer {
+public:
+    SoftRasterizer();
+
+    void resize(int width, int height);
+    // Fills the color buffer with argb and resets the depth buffer
+    void clear(unsigned int argb);
+    // clip is a column major model-view-projection matrix, like OpenGL's.
+    // normals are per corner, in the layout of STLFile::getNormals
+    void draw(const float *positions, const float *normals, size_t num_tris,
+              const float clip[16], const RasterLighting &lighting);
+
+    int width() const;
+    int height() const;
+    // Rows of 0xAARRGGBB pixels, top row first, as QImage::Format_RGB32 expects
+    const unsigned int *pixels() const;
+
+private:
+    void binTriangle(const ScreenVertex v[3], unsigned int id,
+                     std::vector<unsigned int> *tileBins) const;
+    static void clipNear(const float clip[16], const float *p, const float *n,
+                         float fw, float fh, const RasterLighting &lighting,
+                         std::vector<ClippedTriangle> &out);
+    void drawTile(size_t tile, const float *positions, const float *normals,
+                  const float clip[16], const RasterLighting &lighting);
+
+    int w;
+    int h;
+    int tilesX;
+    int tilesY;
+    std::vector<unsigned int> color;
+    std::vector<float> depth;
+    // Triangles touching each tile, a set of bins per thread: bins[thread*numTiles + tile]
+    std::vector<std::vector<unsigned int> > bins;
+    // Pieces of triangles cut by the near plane, one list per set of bins
+    std::vector<std::vector<ClippedTriangle> > clipped;
+    size_t numBinSets;
+};
+
+#endif
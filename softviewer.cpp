@@ -0,0 +1,158 @@
+/*
+  softviewer.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QtGui>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "softviewer.h"
+#include "stlfile.h"
+
+SoftViewer::SoftViewer(QWidget *parent) : QWidget(parent), stlf(new STLFile()),
+                                          rotationX(DEFAULT_ROTATION_X),
+                                          rotationY(DEFAULT_ROTATION_Y),
+                                          rotationZ(0.0f), translate(250.0f) {
+    setWindowTitle(tr("STLViewer (software rendering)"));
+    setFocusPolicy(Qt::StrongFocus);
+    // Every pixel is painted from the rasterizer's buffer
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+SoftViewer::~SoftViewer() {
+    delete stlf;
+}
+
+/*!
+  Reads fileName in the foreground, there's no buffer upload to overlap it with
+*/
+void SoftViewer::openFile(QString fileName) {
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    try {
+        STLFile *loaded = new STLFile(QFile::encodeName(fileName).constData());
+        delete stlf;
+        stlf = loaded;
+        QApplication::restoreOverrideCursor();
+    } catch (std::runtime_error &re) {
+        QApplication::restoreOverrideCursor();
+        QMessageBox::critical(this, tr("STL Viewer"), QString(re.what()));
+        return;
+    }
+    setWindowTitle(tr("%1 - STLViewer (software rendering)").arg(QFileInfo(fileName).fileName()));
+    resetView();
+}
+
+void SoftViewer::open() {
+    QString fileName =
+        QFileDialog::getOpenFileName(this,
+                                     tr("Choose an input file..."),
+                                     tr("."),
+                                     tr("STL Stereolithography File (*.stl);;All Files (*)"));
+    if (!fileName.isEmpty()) {
+        openFile(fileName);
+    }
+}
+
+void SoftViewer::resetView() {
+    translate = calculateMinimumZoom();
+    rotationX = DEFAULT_ROTATION_X;
+    rotationY = DEFAULT_ROTATION_Y;
+    rotationZ = 0.0f;
+    update();
+}
+
+float SoftViewer::calculateMinimumZoom() const {
+    return SceneSetup::minimumZoom(stlf->getBoundingRadius());
+}
+
+/*!
+  Draws the whole frame on the CPU, then copies it to the screen
+*/
+void SoftViewer::paintEvent(QPaintEvent *) {
+    QElapsedTimer timer;
+    timer.start();
+
+    raster.resize(width(), height());
+    raster.clear(0xffffffffu);
+    if (stlf->getNumTris() > 0) {
+        float center[3];
+        stlf->getCenter(center);
+        // Lights sit outside the model, where STLViewer puts them
+        scene.placeLights(calculateMinimumZoom(), center);
+        RasterLighting lighting;
+        scene.rasterLighting(SURF_MAT, lighting);
+        float clip[16];
+        SceneSetup::cameraMatrix(translate, rotationX, rotationY, rotationZ, center, clip);
+        raster.draw(stlf->getPositions(), stlf->getNormals(), stlf->getNumTris(), clip, lighting);
+    }
+    double msecs = timer.nsecsElapsed()*1.0e-6;
+
+    QPainter painter(this);
+    if (raster.pixels()) {
+        // Wraps the buffer without copying it
+        QImage frame((const uchar*)raster.pixels(), raster.width(), raster.height(),
+                     QImage::Format_RGB32);
+        painter.drawImage(0, 0, frame);
+    }
+    painter.setPen(Qt::black);
+    painter.drawText(rect().adjusted(4, 4, -4, -4), Qt::AlignLeft | Qt::AlignBottom,
+                     tr("%1 triangles, %2 ms per frame (software)")
+                     .arg(stlf->getNumTris()).arg(msecs, 0, 'f', 1));
+}
+
+void SoftViewer::mousePressEvent(QMouseEvent *event) {
+    lastPos = event->pos();
+}
+
+void SoftViewer::mouseMoveEvent(QMouseEvent *event) {
+    float dx = float(event->x() - lastPos.x())/width();
+    float dy = float(event->y() - lastPos.y())/height();
+
+    // The same controls as STLViewer
+    if (event->buttons() & Qt::LeftButton) {
+        rotationX += 180*dy;
+        rotationY += 180*dx;
+        update();
+    } else if (event->buttons() & Qt::RightButton) {
+        rotationX += 180*dy;
+        rotationZ += 180*dx;
+        update();
+    }
+    lastPos = event->pos();
+}
+
+void SoftViewer::wheelEvent(QWheelEvent *event) {
+    float minz = calculateMinimumZoom();
+    float dz = -0.125f*0.25f*0.25f*minz;
+    translate = std::max(minz, translate + event->delta()*dz);
+    update();
+}
+
+/*!
+  There's no menu bar, so Ctrl+O opens a file and R resets the view
+*/
+void SoftViewer::keyPressEvent(QKeyEvent *event) {
+    if (event->matches(QKeySequence::Open)) {
+        open();
+    } else if (event->key() == Qt::Key_R) {
+        resetView();
+    } else {
+        QWidget::keyPressEvent(event);
+    }
+}
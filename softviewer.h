@@ -0,0 +1,70 @@
+/*
+  softviewer.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SOFT_VIEWER_HEADER
+#define SOFT_VIEWER_HEADER
+
+#include <QWidget>
+#include <QPoint>
+#include <QString>
+
+#include "scenesetup.h"
+#include "softrasterizer.h"
+
+class STLFile;
+
+/*!
+  A plain widget that shows a model with SoftRasterizer, for systems
+  without OpenGL.  It turns and zooms like STLViewer, but only draws the
+  lit surface.
+*/
+class SoftViewer : public QWidget {
+    Q_OBJECT;
+
+public:
+    SoftViewer(QWidget *parent = 0);
+    ~SoftViewer();
+
+    void openFile(QString fileName);
+    void resetView();
+
+public slots:
+    void open();
+
+protected:
+    void paintEvent(QPaintEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void wheelEvent(QWheelEvent *event);
+    void keyPressEvent(QKeyEvent *event);
+
+private:
+    float calculateMinimumZoom() const;
+
+    STLFile *stlf;
+    SoftRasterizer raster;
+    SceneSetup scene;
+
+    float rotationX;
+    float rotationY;
+    float rotationZ;
+    float translate;
+    QPoint lastPos;
+};
+
+#endif
@@ -17,174 +17,1367 @@
 */
 
 #include "stlfile.h"
+#include "mappedfile.h"
+#include "fastfloat.h"
 
 #include <string>
 #include <cmath>
+#include <cfloat>
 #include <cstdio>
 #include <cstring>
 
 #include <cstdlib>
 
 #include <stdexcept>
+#include <new>
+#include <algorithm>
 
-void computeMostDistant(float *cur_vert, float *new_verts);
-    
-STLFile::STLFile(std::string fname) {
-    // Because FILE* is easier to use than the C++ stuff
-    FILE *inf = std::fopen(fname.c_str(), "rb");
-    if (inf == NULL) {
-        throw std::runtime_error(std::string("Cannot open file ") + fname);
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Triangles between progress reports while decoding binary files
+static const size_t PROGRESS_INTERVAL = 1<<18;
+
+// Bump whenever the cache layout or the meaning of its contents changes
+static const uint32_t CACHE_VERSION = 2;
+static const char CACHE_MAGIC[8] = {'S', 'T', 'L', 'C', 'A', 'C', 'H', 'E'};
+// Bytes from each end of the source file that go into the content hash
+static const size_t CACHE_HASH_SAMPLE = 1<<20;
+
+// Triangles encoded per chunk when saving; chunks are encoded in parallel
+static const size_t SAVE_CHUNK_TRIS = 1<<16;
+
+// Facets with the sine of their corner angle under this have no usable winding normal
+static const float DEGENERATE_SIN = 1.0e-6f;
+
+/*!
+  Fixed size header at the start of a cache file.
+  The position and normal streams follow at data_offset, 64 byte aligned.
+*/
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t data_offset;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t content_hash;
+    uint64_t path_hash;
+    uint64_t num_tris;
+    float bounds_min[3];
+    float bounds_max[3];
+    float centroid[3];
+    float sphere_center[3];
+    float sphere_radius;
+    char stl_header[80];
+};
+
+static uint64_t fnv1a(const void *data, size_t len, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    for (size_t i=0; i<len; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*!
+  Fills key from the source file's size, modification time, path, and a hash
+  of its first and last megabyte.  Hashing the whole file would cost as much
+  as parsing it, and size plus mtime already catch nearly every change.
+*/
+static bool make_cache_key(const std::string &fname, const MappedFile &mf, STLCacheKey &key) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(fname.c_str(), &st) != 0) {
+        return false;
+    }
+#else
+    struct stat st;
+    if (stat(fname.c_str(), &st) != 0) {
+        return false;
+    }
+#endif
+    key.source_size = mf.size();
+    key.source_mtime = (long long)st.st_mtime;
+    key.path_hash = fnv1a(fname.data(), fname.size());
+
+    size_t head = std::min(mf.size(), CACHE_HASH_SAMPLE);
+    uint64_t hash = fnv1a(mf.data(), head);
+    if (mf.size() > head) {
+        size_t tail = std::min(mf.size() - head, CACHE_HASH_SAMPLE);
+        hash = fnv1a(mf.data() + mf.size() - tail, tail, hash);
     }
+    key.content_hash = hash;
+    return true;
+}
+
+static std::string cache_path(const std::string &cache_dir, const STLCacheKey &key) {
+    char name[64];
+    std::sprintf(name, "%016llx.stlcache", (unsigned long long)key.path_hash);
+    return cache_dir + "/" + name;
+}
     
-    char buffer[6];
-    size_t bytes_read = fread(buffer, 1, 6, inf);
-    if (bytes_read != 6) {
+STLFile::STLFile(std::string fname, STLProgress *progress, std::string cache_dir) {
+    std::memset(header, 0, sizeof(header));
+
+    MappedFile mf(fname);
+    if (mf.size() < 6) {
         throw std::runtime_error("Invalid STL file - could not read first 6 bytes.");
     }
-    std::rewind(inf);
-    if (0 == std::memcmp(buffer, "solid ", 6)) {
-        read_ascii_file(inf);
+
+    std::string cache_fname;
+    STLCacheKey key;
+    if (!cache_dir.empty() && make_cache_key(fname, mf, key)) {
+        cache_fname = cache_path(cache_dir, key);
+        if (read_cache(cache_fname, key)) {
+            if (progress) {
+                progress->progress(mf.size(), mf.size(), getNumTris());
+            }
+            return;
+        }
+    }
+
+    // Some exporters start binary headers with "solid " too, so a file whose
+    // size matches the binary layout exactly is treated as binary regardless
+    bool is_binary = (0 != std::memcmp(mf.data(), "solid ", 6));
+    if (!is_binary && mf.size() >= BINARY_HEADER_SIZE) {
+        unsigned int num_tris = 0;
+        std::memcpy(&num_tris, mf.data() + 80, sizeof(unsigned int));
+        is_binary = (mf.size() == BINARY_HEADER_SIZE + size_t(num_tris)*BINARY_TRI_SIZE);
+    }
+
+    if (is_binary) {
+        read_binary_file(mf.data(), mf.size(), progress);
     } else {
-        read_binary_file(inf);
+        read_ascii_file(mf.data(), mf.size(), progress);
+    }
+    computeBounds();
+
+    if (!cache_fname.empty()) {
+        // A missing cache only costs time next load, so failures are ignored
+        write_cache(cache_fname, key);
     }
-    std::fclose(inf);
 }
 
 STLFile::STLFile() {
+    std::memset(header, 0, sizeof(header));
+    computeBounds();
 }
 
 STLFile::~STLFile() {
 }
 
-void read_vert_from_line(const char *buffer, const char *prefix, float *verts) {
-    size_t preLen = strlen(prefix);
-    size_t off = 0;
-    while (buffer[off] == ' ' || buffer[off]=='\t') ++off;
-    
-    if (0 != std::memcmp(off+buffer, prefix, preLen-1)) {
-        throw std::runtime_error(buffer);
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+/*!
+  Splits the text of an ASCII STL file into whitespace separated tokens.
+  Line breaks carry no meaning, so any amount of whitespace and arbitrarily
+  long lines are fine.
+*/
+class AsciiScanner {
+public:
+    AsciiScanner(const char *b, const char *e) : cur(b), end(e) {
     }
-    const char *tmp = (char*)buffer+preLen+off+1;
 
-    char *end;
-    // This should be strtof, but msvc++ is stupid and doesn't support it
-    verts[0] = float(std::strtod(tmp, &end));
-    verts[1] = float(std::strtod(end, &end));
-    verts[2] = float(std::strtod(end, &end));
-}
+    // Sets tb/te to the next token, returns false at the end of the buffer
+    bool next(const char *&tb, const char *&te) {
+        while (cur < end && is_space(*cur)) ++cur;
+        if (cur == end) {
+            return false;
+        }
+        tb = cur;
+        while (cur < end && !is_space(*cur)) ++cur;
+        te = cur;
+        return true;
+    }
 
-void STLFile::read_ascii_file(FILE *inf) {
-    char buffer[256] = {'\0'};
-    char *rval = 0;
+    void expect(const char *word) {
+        const char *tb, *te;
+        if (!next(tb, te) || !matches(tb, te, word)) {
+            throw std::runtime_error(std::string("Invalid ASCII STL file - expected \"") + word + "\"");
+        }
+    }
 
-    rval = fgets(buffer, 255, inf);
-    if (rval == NULL) {
-        throw std::runtime_error("Could not read first line of ASCII file.");
+    void readFloats(float *out, size_t count) {
+        for (size_t i=0; i<count; ++i) {
+            const char *tb, *te;
+            if (!next(tb, te)) {
+                throw std::runtime_error("Invalid ASCII STL file - unexpected end of file.");
+            }
+            out[i] = parse_float(tb, te);
+        }
     }
 
-    most_extreme_point[0] = most_extreme_point[1] = most_extreme_point[2] = 0.0f;
-    rval = fgets(buffer, 255, inf);
+    // Skips the name after "solid" or "endsolid", which runs to the end of
+    // its line.  In a file without line breaks it ends at "facet normal".
+    void skipName() {
+        while (cur < end && *cur != '\n') {
+            if (is_space(*cur)) {
+                ++cur;
+                continue;
+            }
+            const char *tb = cur;
+            const char *te = cur;
+            while (te < end && !is_space(*te)) ++te;
+            if (matches(tb, te, "facet")) {
+                AsciiScanner ahead(te, end);
+                const char *nb, *ne;
+                if (ahead.next(nb, ne) && matches(nb, ne, "normal")) {
+                    return;
+                }
+            }
+            cur = te;
+        }
+    }
 
-    while (0 != std::memcmp(buffer, "endsolid", 8)) {
+    const char *position() const {
+        return cur;
+    }
 
-        float next_tri[12];
-        read_vert_from_line(buffer, "facet normal", next_tri);
+    static bool matches(const char *tb, const char *te, const char *word) {
+        size_t len = std::strlen(word);
+        return size_t(te-tb) == len && 0 == std::memcmp(tb, word, len);
+    }
 
-        // Read and ignore "outer loop"
-        rval = fgets(buffer, 255, inf);
+private:
+    static float parse_float(const char *tb, const char *te) {
+        float val;
+        if (!::parse_float(tb, te, val)) {
+            throw std::runtime_error(std::string("Invalid ASCII STL file - bad number ") + std::string(tb, te));
+        }
+        return val;
+    }
 
-        // Read vertices
-        rval = fgets(buffer, 255, inf);
-        read_vert_from_line(buffer, "vertex", next_tri+3);
-        
-        rval = fgets(buffer, 255, inf);
-        read_vert_from_line(buffer, "vertex", next_tri+6);
-        
-        rval = fgets(buffer, 255, inf);
-        read_vert_from_line(buffer, "vertex", next_tri+9);
+    const char *cur;
+    const char *end;
+};
 
-        computeMostDistant(most_extreme_point, next_tri + 3);
-        tris.push_back(Triangle(next_tri));
+/*!
+  Position and normal streams for the triangles parsed by one thread
+*/
+struct TriangleBuffer {
+    std::vector<float> positions;
+    std::vector<float> normals;
 
-        // Read and ingore "endloop"
-        rval = fgets(buffer, 255, inf);
+    void reserve(size_t num_tris) {
+        positions.reserve(9*num_tris);
+        normals.reserve(9*num_tris);
+    }
 
-        // Read and ignore "endfacet"
-        rval = fgets(buffer, 255, inf);
+    // Appends a triangle given as a normal followed by three vertices
+    void add(const float tri[12]) {
+        positions.insert(positions.end(), tri + 3, tri + 12);
+        for (size_t i=0; i<3; ++i) {
+            normals.insert(normals.end(), tri, tri + 3);
+        }
+    }
+};
+
+/*!
+  Returns the start of the first "facet" token at or after pos, or end if there isn't one.
+*/
+static const char *find_facet(const char *pos, const char *begin, const char *end) {
+    static const char word[] = "facet";
+    const size_t len = sizeof(word) - 1;
+    while (pos + len <= end) {
+        const char *hit = (const char*)std::memchr(pos, 'f', size_t(end - pos) - len + 1);
+        if (hit == 0) {
+            break;
+        }
+        if (0 == std::memcmp(hit, word, len) &&
+            (hit == begin || is_space(hit[-1])) &&
+            (hit + len == end || is_space(hit[len]))) {
+            return hit;
+        }
+        pos = hit + 1;
+    }
+    return end;
+}
+
+/*!
+  Parses every facet whose "facet" keyword starts in [begin, stop).
+  The last facet may run past stop, but not past end.
+*/
+static void parse_ascii_chunk(const char *begin, const char *stop, const char *end,
+                              TriangleBuffer &out) {
+    AsciiScanner scan(begin, end);
+    const char *tb, *te;
+    while (scan.position() < stop && scan.next(tb, te)) {
+        if (tb >= stop) {
+            break;
+        }
+        if (AsciiScanner::matches(tb, te, "solid") || AsciiScanner::matches(tb, te, "endsolid")) {
+            scan.skipName();
+            continue;
+        }
+        if (!AsciiScanner::matches(tb, te, "facet")) {
+            throw std::runtime_error("Invalid ASCII STL file - expected \"facet\" or \"endsolid\", found \"" +
+                                     std::string(tb, te) + "\"");
+        }
+        float next_tri[12];
+        scan.expect("normal");
+        scan.readFloats(next_tri, 3);
+        scan.expect("outer");
+        scan.expect("loop");
+        for (size_t i=0; i<3; ++i) {
+            scan.expect("vertex");
+            scan.readFloats(next_tri + 3 + 3*i, 3);
+        }
+        scan.expect("endloop");
+        scan.expect("endfacet");
 
-        // Read first line of next triangle or "endsolid"
-        rval = fgets(buffer, 255, inf);
+        out.add(next_tri);
     }
 }
 
-void computeMostDistant(float *cur_vert, float *new_verts) {
-    double old_dist = cur_vert[0]*cur_vert[0] + cur_vert[1]*cur_vert[1] + cur_vert[2]*cur_vert[2];
-    for (size_t i=0;i<3; ++i) {
-        double new_dist = new_verts[3*i+0]*new_verts[3*i+0] + new_verts[3*i+1]*new_verts[3*i+1] + new_verts[3*i+2]*new_verts[3*i+2];
-        if (new_dist > old_dist) {
-            cur_vert[0] = new_verts[3*i+0];
-            cur_vert[1] = new_verts[3*i+1];
-            cur_vert[2] = new_verts[3*i+2];
-            old_dist = new_dist;
+// Why read_ascii_file stops handing out chunks
+enum AsciiStop {
+    ASCII_KEEP_GOING,
+    ASCII_PARSE_ERROR,
+    ASCII_OUT_OF_MEMORY,
+    ASCII_CANCELLED
+};
+
+/*!
+  Parses an ASCII STL file in parallel.
+  The text is split into roughly equal chunks, each chunk boundary is moved
+  forward to the next "facet" keyword, and every chunk is parsed on its own
+  thread into its own triangle list.  The lists are then joined in file order.
+*/
+void STLFile::read_ascii_file(const char *data, size_t size, STLProgress *progress) {
+    const char *end = data + size;
+
+    // Chunks are capped in size so progress updates and cancelling stay responsive
+    const size_t MIN_CHUNK_SIZE = 1<<20;
+    const size_t MAX_CHUNK_SIZE = 1<<26;
+    size_t num_chunks = 1;
+#ifdef _OPENMP
+    num_chunks = 4*size_t(omp_get_max_threads());
+#endif
+    if (size/MAX_CHUNK_SIZE > num_chunks) {
+        num_chunks = size/MAX_CHUNK_SIZE;
+    }
+    if (size/MIN_CHUNK_SIZE < num_chunks) {
+        num_chunks = size/MIN_CHUNK_SIZE + 1;
+    }
+
+    std::vector<const char*> bounds(num_chunks+1);
+    // The first chunk starts at "solid name", which parse_ascii_chunk skips
+    bounds[0] = data;
+    bounds[num_chunks] = end;
+    for (size_t i=1; i<num_chunks; ++i) {
+        bounds[i] = find_facet(data + i*(size/num_chunks), data, end);
+    }
+
+    std::vector<TriangleBuffer> chunk_tris(num_chunks);
+    // Only read or written inside critical(stl_ascii_stop), along with error
+    int stop = ASCII_KEEP_GOING;
+    std::string error;
+    size_t bytes_done = 0;
+    size_t tris_done = 0;
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long i=0; i<long(num_chunks); ++i) {
+        int stopped;
+#pragma omp critical(stl_ascii_stop)
+        stopped = stop;
+        if (stopped != ASCII_KEEP_GOING) {
+            continue;
+        }
+        try {
+            if (bounds[i] < bounds[i+1]) {
+                // Rough guess of ~250 bytes per facet to avoid most reallocation
+                chunk_tris[i].reserve(size_t(bounds[i+1] - bounds[i])/250 + 1);
+                parse_ascii_chunk(bounds[i], bounds[i+1], end, chunk_tris[i]);
+            }
+        } catch (std::runtime_error &re) {
+#pragma omp critical(stl_ascii_stop)
+            if (stop == ASCII_KEEP_GOING) {
+                stop = ASCII_PARSE_ERROR;
+                error = re.what();
+            }
+        } catch (std::bad_alloc &) {
+            // Exceptions can't leave the parallel loop, so it's rethrown after
+#pragma omp critical(stl_ascii_stop)
+            if (stop == ASCII_KEEP_GOING) {
+                stop = ASCII_OUT_OF_MEMORY;
+            }
         }
+        if (progress) {
+            int reason = ASCII_KEEP_GOING;
+#pragma omp critical(stl_ascii_progress)
+            try {
+                size_t chunk_size = chunk_tris[i].positions.size()/9;
+                if (chunk_size > 0) {
+                    progress->trianglesDecoded(&chunk_tris[i].positions[0], &chunk_tris[i].normals[0], chunk_size);
+                }
+                bytes_done += size_t(bounds[i+1] - bounds[i]);
+                tris_done += chunk_size;
+                if (!progress->progress(bytes_done, size, tris_done)) {
+                    reason = ASCII_CANCELLED;
+                }
+            } catch (std::bad_alloc &) {
+                reason = ASCII_OUT_OF_MEMORY;
+            }
+            if (reason != ASCII_KEEP_GOING) {
+                // Cancelling wins over an error, so no error is shown for it
+#pragma omp critical(stl_ascii_stop)
+                if (stop == ASCII_KEEP_GOING || reason == ASCII_CANCELLED) {
+                    stop = reason;
+                }
+            }
+        }
+    }
+    if (stop == ASCII_CANCELLED) {
+        throw STLLoadCancelled();
+    }
+    if (stop == ASCII_OUT_OF_MEMORY) {
+        throw std::bad_alloc();
+    }
+    if (stop == ASCII_PARSE_ERROR) {
+        throw std::runtime_error(error);
+    }
+
+    size_t total = 0;
+    for (size_t i=0; i<num_chunks; ++i) {
+        total += chunk_tris[i].positions.size();
+    }
+    positions.reserve(total);
+    normals.reserve(total);
+    for (size_t i=0; i<num_chunks; ++i) {
+        positions.insert(positions.end(), chunk_tris[i].positions.begin(), chunk_tris[i].positions.end());
+        normals.insert(normals.end(), chunk_tris[i].normals.begin(), chunk_tris[i].normals.end());
+        std::vector<float>().swap(chunk_tris[i].positions);
+        std::vector<float>().swap(chunk_tris[i].normals);
     }
 }
-void STLFile::read_binary_file(FILE *inf) {
-    char buffer[80];
-    size_t num_read = fread(buffer, 1, 80, inf);
-    if (num_read != 80) {
-        throw std::runtime_error("Invalid binary STL file - could not read 80 byte header.");
+
+/*!
+  Decodes a memory mapped binary STL file.
+  The size is validated up front, so every 50 byte record can be copied
+  straight into preallocated storage without any per-triangle reads.
+*/
+void STLFile::read_binary_file(const char *data, size_t size, STLProgress *progress) {
+    if (size < BINARY_HEADER_SIZE) {
+        throw std::runtime_error("Invalid binary STL file - could not read 80 byte header and triangle count.");
     }
-    std::memcpy(header, buffer, 80);
+    std::memcpy(header, data, 80);
 
     unsigned int num_tris = 0;
-    num_read = std::fread(&num_tris, sizeof(unsigned int), 1, inf);
-    if (num_read != 1) {
-        throw std::runtime_error("Invalid binary STL file - could not read number of triangles from binary STL file.");
+    std::memcpy(&num_tris, data + 80, sizeof(unsigned int));
+    if (size < BINARY_HEADER_SIZE + size_t(num_tris)*BINARY_TRI_SIZE) {
+        throw std::runtime_error("Invalid binary STL file - file is too short for its triangle count.");
     }
-    most_extreme_point[0] = most_extreme_point[1] = most_extreme_point[2] = 0.0f;
-    
-    float next_tri[12];
-    for (size_t i=0; i< num_tris; ++i) {
-        num_read = fread(next_tri, sizeof(float), 12, inf);
-        if (num_read != 12) {
-            throw std::runtime_error("Could not read a full triangle.");
+    positions.resize(9*size_t(num_tris));
+    normals.resize(9*size_t(num_tris));
+    const char *rec = data + BINARY_HEADER_SIZE;
+    for (size_t i=0; i< num_tris; ++i, rec += BINARY_TRI_SIZE) {
+        // Records are only 2 byte aligned, so memcpy instead of casting
+        float *norm = &normals[9*i];
+        std::memcpy(norm, rec, sizeof(float)*3);
+        std::memcpy(norm+3, norm, sizeof(float)*3);
+        std::memcpy(norm+6, norm, sizeof(float)*3);
+        std::memcpy(&positions[9*i], rec + sizeof(float)*3, sizeof(float)*3*3);
+
+        if (progress && ((i+1) % PROGRESS_INTERVAL == 0 || i+1 == num_tris)) {
+            size_t first = i - i % PROGRESS_INTERVAL;
+            progress->trianglesDecoded(&positions[9*first], &normals[9*first], i+1 - first);
+            if (!progress->progress(size_t(rec - data) + BINARY_TRI_SIZE, size, i+1)) {
+                throw STLLoadCancelled();
+            }
+        }
+    }
+}
+
+size_t STLFile::getNumTris() const {
+    return positions.size()/9;
+}
+
+static inline float distance2(const float *a, const float *b) {
+    float d[3] = {a[0]-b[0], a[1]-b[1], a[2]-b[2]};
+    return d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+}
+
+/*!
+  Grows the sphere (center, radius) just enough to hold the sphere
+  (other, other_radius), keeping the far side of the old one fixed.
+  A radius of 0 makes this Ritter's update for a single point.
+*/
+static void merge_spheres(float center[3], float &radius, const float other[3], float other_radius) {
+    float dist = std::sqrt(distance2(other, center));
+    if (dist + other_radius <= radius) {
+        return;
+    }
+    if (dist + radius <= other_radius) {
+        std::copy(other, other+3, center);
+        radius = other_radius;
+        return;
+    }
+    float new_radius = 0.5f*(dist + radius + other_radius);
+    float t = (new_radius - radius)/dist;
+    for (size_t k=0; k<3; ++k) {
+        center[k] += t*(other[k] - center[k]);
+    }
+    radius = new_radius;
+}
+
+/*!
+  Finds the bounding box, the centroid and a bounding sphere in two parallel
+  passes over the finished positions, kept out of the parsers so the hot
+  loops stay simple.  Both passes are limited by memory bandwidth, so the
+  work is arranged to read the positions as few times as possible.
+
+  The sphere comes from Ritter's algorithm, seeded with the longest side of
+  the box rather than the farthest apart extreme vertices, which would mean
+  tracking indices in the first pass.  Each thread grows its own copy over
+  its share of the vertices before the copies are merged.  The same pass
+  measures the spheres around the box center and the centroid, which are
+  tighter for some shapes, and the smallest of the three is kept.
+*/
+void STLFile::computeBounds() {
+    const long num_verts = long(positions.size()/3);
+    if (num_verts == 0) {
+        std::fill(bounds_min, bounds_min+3, 0.0f);
+        std::fill(bounds_max, bounds_max+3, 0.0f);
+        std::fill(centroid, centroid+3, 0.0f);
+        std::fill(sphere_center, sphere_center+3, 0.0f);
+        sphere_radius = 0.0f;
+        return;
+    }
+    const float *vp = &positions[0];
+    const long num_tris = num_verts/3;
+
+    double sum[3] = {0.0, 0.0, 0.0};
+    std::copy(vp, vp+3, bounds_min);
+    std::copy(vp, vp+3, bounds_max);
+#pragma omp parallel
+    {
+        // One lane per float of a triangle, so the loop vectorizes
+        float lmin[9];
+        float lmax[9];
+        double lsum[9];
+        for (size_t j=0; j<9; ++j) {
+            lmin[j] = lmax[j] = vp[j%3];
+            lsum[j] = 0.0;
         }
-        computeMostDistant(most_extreme_point, next_tri + 3);
-        tris.push_back(Triangle(next_tri));
+#pragma omp for nowait
+        for (long i=0; i<num_tris; ++i) {
+            const float *v = vp + 9*i;
+            for (size_t j=0; j<9; ++j) {
+                lmin[j] = std::min(lmin[j], v[j]);
+                lmax[j] = std::max(lmax[j], v[j]);
+                lsum[j] += v[j];
+            }
+        }
+#pragma omp critical(stl_bounds)
+        for (size_t j=0; j<9; ++j) {
+            bounds_min[j%3] = std::min(bounds_min[j%3], lmin[j]);
+            bounds_max[j%3] = std::max(bounds_max[j%3], lmax[j]);
+            sum[j%3] += lsum[j];
+        }
+    }
+    for (size_t k=0; k<3; ++k) {
+        centroid[k] = float(sum[k]/double(num_verts));
+    }
 
-        unsigned short whatever = 0;
-        num_read = fread(&whatever, 2, 1, inf);
-        if (num_read != 1) {
-            throw std::runtime_error("Could not read a full triangle.");
+    // Ritter's seed, spanning the longest side of the box
+    float ritter_center[3];
+    float ritter_radius = 0.0f;
+    for (size_t k=0; k<3; ++k) {
+        ritter_center[k] = 0.5f*(bounds_min[k] + bounds_max[k]);
+        ritter_radius = std::max(ritter_radius, 0.5f*(bounds_max[k] - bounds_min[k]));
+    }
+
+    // Other centers to try, measured while the Ritter sphere grows
+    const float candidates[2][3] = {
+        {0.5f*(bounds_min[0] + bounds_max[0]), 0.5f*(bounds_min[1] + bounds_max[1]),
+         0.5f*(bounds_min[2] + bounds_max[2])},
+        {centroid[0], centroid[1], centroid[2]}
+    };
+    float far2[2] = {0.0f, 0.0f};
+#pragma omp parallel
+    {
+        float lcenter[3] = {ritter_center[0], ritter_center[1], ritter_center[2]};
+        float lradius = ritter_radius;
+        float lfar2[2] = {0.0f, 0.0f};
+#pragma omp for nowait
+        for (long i=0; i<num_verts; ++i) {
+            const float *v = vp + 3*i;
+            lfar2[0] = std::max(lfar2[0], distance2(v, candidates[0]));
+            lfar2[1] = std::max(lfar2[1], distance2(v, candidates[1]));
+            if (distance2(v, lcenter) > lradius*lradius) {
+                merge_spheres(lcenter, lradius, v, 0.0f);
+            }
+        }
+#pragma omp critical(stl_sphere)
+        {
+            merge_spheres(ritter_center, ritter_radius, lcenter, lradius);
+            far2[0] = std::max(far2[0], lfar2[0]);
+            far2[1] = std::max(far2[1], lfar2[1]);
         }
     }
+
+    std::copy(ritter_center, ritter_center+3, sphere_center);
+    sphere_radius = ritter_radius;
+    for (size_t c=0; c<2; ++c) {
+        if (std::sqrt(far2[c]) < sphere_radius) {
+            std::copy(candidates[c], candidates[c]+3, sphere_center);
+            sphere_radius = std::sqrt(far2[c]);
+        }
+    }
+    // Padded so float rounding can't leave the farthest vertex just outside
+    sphere_radius *= 1.0f + 4.0f*FLT_EPSILON;
+}
+
+/*!
+  Axis aligned bounding box of every vertex.  Both corners are 0 for an empty mesh.
+*/
+void STLFile::getBounds(float min[3], float max[3]) const {
+    std::copy(bounds_min, bounds_min+3, min);
+    std::copy(bounds_max, bounds_max+3, max);
+}
+
+void STLFile::getCenter(float center[3]) const {
+    std::copy(sphere_center, sphere_center+3, center);
 }
 
-size_t STLFile::getNumTris() {
-    return tris.size();
+void STLFile::getCentroid(float center[3]) const {
+    std::copy(centroid, centroid+3, center);
 }
 
-float STLFile::getBoundingRadius() {
-    return 1.1f*std::sqrt(most_extreme_point[0]*most_extreme_point[0] +
-                         most_extreme_point[1]*most_extreme_point[1] +
-                         most_extreme_point[2]*most_extreme_point[2]);
+float STLFile::getBoundingRadius() const {
+    return sphere_radius;
 }
-void STLFile::fillBuffers(size_t max_tris, float *verts, float *norms, unsigned int *indices) {
 
-    size_t nt = max_tris;
-    if (tris.size()<max_tris) {
-        nt = tris.size();
+double STLFile::getSurfaceArea() const {
+    const long num_tris = long(positions.size()/9);
+    double area = 0.0;
+#pragma omp parallel for reduction(+:area)
+    for (long i=0; i<num_tris; ++i) {
+        const float *v = &positions[9*i];
+        double a[3] = {v[3]-v[0], v[4]-v[1], v[5]-v[2]};
+        double b[3] = {v[6]-v[0], v[7]-v[1], v[8]-v[2]};
+        double c[3] = {a[1]*b[2] - a[2]*b[1],
+                       a[2]*b[0] - a[0]*b[2],
+                       a[0]*b[1] - a[1]*b[0]};
+        area += 0.5*std::sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]);
     }
-    
-    for (size_t i=0; i<nt; ++i) {
-        memcpy(norms + 3*(3*i+0), tris[i].normal, sizeof(float)*3);
-        memcpy(norms + 3*(3*i+1), tris[i].normal, sizeof(float)*3);
-        memcpy(norms + 3*(3*i+2), tris[i].normal, sizeof(float)*3);
+    return area;
+}
+
+/*!
+  Sums the signed volumes of the tetrahedra from the origin to each facet
+*/
+double STLFile::getVolume() const {
+    const long num_tris = long(positions.size()/9);
+    double volume = 0.0;
+#pragma omp parallel for reduction(+:volume)
+    for (long i=0; i<num_tris; ++i) {
+        const float *v = &positions[9*i];
+        volume += (double(v[0])*(double(v[4])*v[8] - double(v[5])*v[7]) -
+                   double(v[1])*(double(v[3])*v[8] - double(v[5])*v[6]) +
+                   double(v[2])*(double(v[3])*v[7] - double(v[4])*v[6]))/6.0;
+    }
+    return volume;
+}
+
+/*!
+  Flags facets whose stored normal disagrees with their winding, and facets
+  too thin to have a winding normal.  The loop is branch free apart from
+  the final classification so it vectorizes.
+*/
+NormalCheckCounts STLFile::checkNormals(std::vector<unsigned char> &flags) const {
+    const long num_tris = long(positions.size()/9);
+    flags.resize(num_tris);
+    unsigned char *out = flags.empty() ? 0 : &flags[0];
+    long flipped = 0;
+    long degenerate = 0;
+    long unset = 0;
+#pragma omp parallel for reduction(+:flipped, degenerate, unset)
+    for (long i=0; i<num_tris; ++i) {
+        const float *v = &positions[9*i];
+        const float *n = &normals[9*i];
+        float e1[3] = {v[3]-v[0], v[4]-v[1], v[5]-v[2]};
+        float e2[3] = {v[6]-v[0], v[7]-v[1], v[8]-v[2]};
+        float c[3] = {e1[1]*e2[2] - e1[2]*e2[1],
+                      e1[2]*e2[0] - e1[0]*e2[2],
+                      e1[0]*e2[1] - e1[1]*e2[0]};
+        float cc = c[0]*c[0] + c[1]*c[1] + c[2]*c[2];
+        float ee = (e1[0]*e1[0] + e1[1]*e1[1] + e1[2]*e1[2])*(e2[0]*e2[0] + e2[1]*e2[1] + e2[2]*e2[2]);
+        float nn = n[0]*n[0] + n[1]*n[1] + n[2]*n[2];
+        float nc = n[0]*c[0] + n[1]*c[1] + n[2]*c[2];
 
-        memcpy(verts+i*3*3, tris[i].verts, sizeof(float)*3*3);
-        indices[3*i + 0] = 3*i+0;
-        indices[3*i + 1] = 3*i+1;
-        indices[3*i + 2] = 3*i+2;
+        int is_degenerate = cc <= DEGENERATE_SIN*DEGENERATE_SIN*ee;
+        int is_unset = !is_degenerate && nn == 0.0f;
+        int is_flipped = !is_degenerate && nc < 0.0f;
+        out[i] = (unsigned char)(is_degenerate ? NORMAL_DEGENERATE :
+                                 is_unset ? NORMAL_UNSET :
+                                 is_flipped ? NORMAL_FLIPPED : NORMAL_OK);
+        degenerate += is_degenerate;
+        unset += is_unset;
+        flipped += is_flipped;
+    }
+    NormalCheckCounts counts;
+    counts.flipped = size_t(flipped);
+    counts.degenerate = size_t(degenerate);
+    counts.unset = size_t(unset);
+    return counts;
+}
+
+const float *STLFile::getPositions() const {
+    return positions.empty() ? 0 : &positions[0];
+}
+
+const float *STLFile::getNormals() const {
+    return normals.empty() ? 0 : &normals[0];
+}
+
+static inline unsigned int hash_key(const unsigned int *key) {
+    unsigned int h = key[0]*73856093u ^ key[1]*19349663u ^ key[2]*83492791u;
+    // Mix the high bits down so "h % n" uses all of them
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    return h;
+}
+
+/*!
+  Welds identical vertices into a unique vertex array and an index per corner.
+  With a positive epsilon, vertices are snapped to a grid with cells epsilon
+  wide and every vertex in the same cell is merged into the first one.
+
+  Hashing runs in parallel: every thread owns the vertices whose hash falls in
+  its bucket, so no locking is needed.  Returns the number of unique vertices.
+*/
+size_t STLFile::weldPositions(float epsilon, std::vector<float> &verts,
+                              std::vector<unsigned int> &indices) const {
+    const size_t num_verts = positions.size()/3;
+    const unsigned int EMPTY = ~0u;
+
+    std::vector<unsigned int> keys(3*num_verts);
+    std::vector<unsigned int> hashes(num_verts);
+    std::vector<unsigned int> ids(num_verts);
+
+#pragma omp parallel for
+    for (long i=0; i<long(num_verts); ++i) {
+        const float *v = &positions[3*i];
+        unsigned int *key = &keys[3*i];
+        for (size_t k=0; k<3; ++k) {
+            if (epsilon > 0.0f) {
+                key[k] = (unsigned int)(long long)std::floor(double(v[k])/epsilon);
+            } else {
+                // Adding 0.0f turns -0.0 into 0.0 so they hash the same
+                float val = v[k] + 0.0f;
+                std::memcpy(key+k, &val, sizeof(float));
+            }
+        }
+        hashes[i] = hash_key(key);
+    }
+
+    // Each thread finds the first vertex with the same key for the vertices in its bucket
+#pragma omp parallel
+    {
+        unsigned int num_buckets = 1;
+        unsigned int bucket = 0;
+#ifdef _OPENMP
+        num_buckets = omp_get_num_threads();
+        bucket = omp_get_thread_num();
+#endif
+        size_t table_size = 64;
+        while (table_size < 2*(num_verts/num_buckets + 1)) {
+            table_size *= 2;
+        }
+        std::vector<unsigned int> table(table_size, EMPTY);
+        for (size_t i=0; i<num_verts; ++i) {
+            if (hashes[i] % num_buckets != bucket) {
+                continue;
+            }
+            size_t slot = (hashes[i] / num_buckets) & (table_size-1);
+            while (true) {
+                unsigned int other = table[slot];
+                if (other == EMPTY) {
+                    table[slot] = (unsigned int)i;
+                    ids[i] = (unsigned int)i;
+                    break;
+                }
+                if (0 == std::memcmp(&keys[3*i], &keys[3*other], sizeof(unsigned int)*3)) {
+                    ids[i] = other;
+                    break;
+                }
+                slot = (slot + 1) & (table_size-1);
+            }
+        }
+    }
+    std::vector<unsigned int>().swap(keys);
+    std::vector<unsigned int>().swap(hashes);
+
+    // ids[i] is the first vertex with the same key, and it's never after i,
+    // so the ids can be renumbered in place in one pass
+    verts.clear();
+    verts.reserve(num_verts);
+    unsigned int num_unique = 0;
+    for (size_t i=0; i<num_verts; ++i) {
+        if (ids[i] == i) {
+            const float *v = &positions[3*i];
+            verts.insert(verts.end(), v, v+3);
+            ids[i] = num_unique++;
+        } else {
+            ids[i] = ids[ids[i]];
+        }
+    }
+    std::vector<float>(verts).swap(verts);
+    indices.swap(ids);
+    return num_unique;
+}
+
+/*!
+  Welds identical vertices into a unique vertex array and a real index buffer.
+  See weldPositions for how epsilon is used.
+  Vertex normals are the area weighted average of the surrounding face normals.
+  Returns the number of unique vertices.
+*/
+size_t STLFile::buildIndexedMesh(float epsilon, std::vector<float> &verts,
+                                 std::vector<float> &norms, std::vector<unsigned int> &indices) {
+    const size_t num_tris = getNumTris();
+    const size_t num_unique = weldPositions(epsilon, verts, indices);
+
+    norms.assign(3*size_t(num_unique), 0.0f);
+    for (size_t i=0; i<num_tris; ++i) {
+        const float *v = &positions[9*i];
+        float a[3] = {v[3]-v[0], v[4]-v[1], v[5]-v[2]};
+        float b[3] = {v[6]-v[0], v[7]-v[1], v[8]-v[2]};
+        // Not normalized, so larger faces count for more
+        float n[3] = {a[1]*b[2] - a[2]*b[1],
+                      a[2]*b[0] - a[0]*b[2],
+                      a[0]*b[1] - a[1]*b[0]};
+        for (size_t k=0; k<3; ++k) {
+            float *vn = &norms[3*indices[3*i+k]];
+            vn[0] += n[0];
+            vn[1] += n[1];
+            vn[2] += n[2];
+        }
+    }
+#pragma omp parallel for
+    for (long i=0; i<long(num_unique); ++i) {
+        float *vn = &norms[3*i];
+        float len = std::sqrt(vn[0]*vn[0] + vn[1]*vn[1] + vn[2]*vn[2]);
+        if (len > 0.0f) {
+            vn[0] /= len;
+            vn[1] /= len;
+            vn[2] /= len;
+        }
+    }
+    return num_unique;
+}
+
+/*!
+  Finds the root of x in a union-find forest where parity[x] says whether x's
+  winding is reversed relative to its parent.  Returns the root, with x's
+  parity relative to it in x_parity, and points the whole path at the root.
+*/
+static unsigned int uf_find(unsigned int *parent, unsigned char *parity,
+                            unsigned int x, unsigned char &x_parity) {
+    unsigned int root = x;
+    unsigned char p = 0;
+    while (parent[root] != root) {
+        p ^= parity[root];
+        root = parent[root];
+    }
+    x_parity = p;
+    while (x != root) {
+        unsigned int next = parent[x];
+        unsigned char next_p = p ^ parity[x];
+        parent[x] = root;
+        parity[x] = p;
+        x = next;
+        p = next_p;
+    }
+    return root;
+}
+
+/*!
+  Joins the sets of a and b, recording that their windings differ if reversed
+  is 1.  Returns false if they're already joined with the opposite relation.
+*/
+static bool uf_union(unsigned int *parent, unsigned char *parity, unsigned char *rank,
+                     unsigned int a, unsigned int b, unsigned char reversed) {
+    unsigned char pa = 0;
+    unsigned char pb = 0;
+    unsigned int ra = uf_find(parent, parity, a, pa);
+    unsigned int rb = uf_find(parent, parity, b, pb);
+    if (ra == rb) {
+        return (pa ^ pb) == reversed;
+    }
+    if (rank[ra] < rank[rb]) {
+        std::swap(ra, rb);
+    }
+    parent[rb] = ra;
+    parity[rb] = pa ^ pb ^ reversed;
+    if (rank[ra] == rank[rb]) {
+        ++rank[ra];
+    }
+    return true;
+}
+
+/*!
+  Repairs the winding and normals of every facet.
+
+  Corners are welded, then each edge is matched with the other facet using it
+  through per thread hash tables, the same way weldPositions works.  Facets
+  sharing an edge are joined in a union-find forest that also records whether
+  one has to be reversed to agree with the other.  Each thread joins the edges
+  inside its own block of facets, and the few edges between blocks are joined
+  afterwards, so every step is linear in the number of facets.
+
+  Closed shells are turned so their signed volume is positive.  Open shells
+  have no inside, so they follow the majority of their stored normals.  Shells
+  aren't tested for nesting, so the wall of a cavity ends up facing into the
+  solid around it instead of into the cavity.
+  Finally every normal is recomputed from the winding; facets too thin to have
+  a winding normal keep their stored one.
+*/
+NormalRepairCounts STLFile::repairNormals() {
+    const unsigned int NO_MATE = ~0u;
+    const unsigned int MANY_MATES = ~0u - 1;
+    const size_t num_tris = getNumTris();
+    const size_t num_edges = 3*num_tris;
+
+    NormalRepairCounts counts;
+    std::memset(&counts, 0, sizeof(counts));
+    if (num_tris == 0) {
+        return counts;
+    }
+
+    std::vector<unsigned int> ids;
+    {
+        std::vector<float> verts;
+        weldPositions(0.0f, verts, ids);
+    }
+
+    // Half edge 3*t+k runs from corner k to corner k+1 of facet t
+    std::vector<unsigned int> hashes(num_edges);
+#pragma omp parallel for
+    for (long e=0; e<long(num_edges); ++e) {
+        unsigned int a = ids[e];
+        unsigned int b = ids[e - e%3 + (e+1)%3];
+        unsigned int key[3] = {std::min(a, b), std::max(a, b), 0};
+        hashes[e] = hash_key(key);
+    }
+
+    // mate[e] is the other half edge on the same edge, e itself if both ends were
+    // welded together, NO_MATE on a boundary and MANY_MATES on a non-manifold edge
+    std::vector<unsigned int> mate(num_edges, NO_MATE);
+#pragma omp parallel
+    {
+        unsigned int num_buckets = 1;
+        unsigned int bucket = 0;
+#ifdef _OPENMP
+        num_buckets = omp_get_num_threads();
+        bucket = omp_get_thread_num();
+#endif
+        size_t table_size = 64;
+        while (table_size < 2*(num_edges/num_buckets + 1)) {
+            table_size *= 2;
+        }
+        std::vector<unsigned int> table(table_size, NO_MATE);
+        for (size_t e=0; e<num_edges; ++e) {
+            if (hashes[e] % num_buckets != bucket) {
+                continue;
+            }
+            unsigned int a = ids[e];
+            unsigned int b = ids[e - e%3 + (e+1)%3];
+            if (a == b) {
+                mate[e] = (unsigned int)e;
+                continue;
+            }
+            size_t slot = (hashes[e] / num_buckets) & (table_size-1);
+            while (true) {
+                unsigned int other = table[slot];
+                if (other == NO_MATE) {
+                    table[slot] = (unsigned int)e;
+                    break;
+                }
+                unsigned int oa = ids[other];
+                unsigned int ob = ids[other - other%3 + (other+1)%3];
+                if ((oa == a && ob == b) || (oa == b && ob == a)) {
+                    unsigned int second = mate[other];
+                    if (second == NO_MATE) {
+                        mate[other] = (unsigned int)e;
+                        mate[e] = other;
+                    } else {
+                        if (second != MANY_MATES) {
+                            mate[second] = MANY_MATES;
+                            mate[other] = MANY_MATES;
+                        }
+                        mate[e] = MANY_MATES;
+                    }
+                    break;
+                }
+                slot = (slot + 1) & (table_size-1);
+            }
+        }
+    }
+    std::vector<unsigned int>().swap(hashes);
+
+    std::vector<unsigned int> parent(num_tris);
+    std::vector<unsigned char> parity(num_tris, 0);
+    std::vector<unsigned char> rank(num_tris, 0);
+#pragma omp parallel for
+    for (long t=0; t<long(num_tris); ++t) {
+        parent[t] = (unsigned int)t;
+    }
+
+    // Two facets using an edge in the same direction need opposite windings
+    long num_blocks = 1;
+#ifdef _OPENMP
+    num_blocks = omp_get_max_threads();
+#endif
+    const size_t block_size = (num_tris + num_blocks - 1)/num_blocks;
+    long conflicts = 0;
+#pragma omp parallel for schedule(static, 1) reduction(+:conflicts)
+    for (long blk=0; blk<num_blocks; ++blk) {
+        size_t first = std::min(num_tris, blk*block_size);
+        size_t last = std::min(num_tris, first + block_size);
+        for (size_t e=3*first; e<3*last; ++e) {
+            unsigned int m = mate[e];
+            if (m >= MANY_MATES || m <= e || m/3 >= last) {
+                continue;
+            }
+            unsigned char reversed = ids[m] == ids[e] ? 1 : 0;
+            if (!uf_union(&parent[0], &parity[0], &rank[0], (unsigned int)(e/3), m/3, reversed)) {
+                ++conflicts;
+            }
+        }
+    }
+    for (size_t e=0; e<num_edges; ++e) {
+        unsigned int m = mate[e];
+        if (m >= MANY_MATES || m <= e || m/3/block_size == e/3/block_size) {
+            continue;
+        }
+        unsigned char reversed = ids[m] == ids[e] ? 1 : 0;
+        if (!uf_union(&parent[0], &parity[0], &rank[0], (unsigned int)(e/3), m/3, reversed)) {
+            ++conflicts;
+        }
+    }
+    counts.conflicts = size_t(conflicts);
+    std::vector<unsigned char>().swap(rank);
+    std::vector<unsigned int>().swap(ids);
+
+    // Flatten the forest so every facet points straight at its root
+    for (size_t t=0; t<num_tris; ++t) {
+        unsigned char p = 0;
+        uf_find(&parent[0], &parity[0], (unsigned int)t, p);
+    }
+
+    // Number the shells, reusing parent for the shell of each facet
+    std::vector<unsigned int> shell_of_root(num_tris);
+    unsigned int num_shells = 0;
+    for (size_t t=0; t<num_tris; ++t) {
+        if (parent[t] == t) {
+            shell_of_root[t] = num_shells++;
+        }
+    }
+#pragma omp parallel for
+    for (long t=0; t<long(num_tris); ++t) {
+        parent[t] = shell_of_root[parent[t]];
+    }
+    std::vector<unsigned int>().swap(shell_of_root);
+
+    // Volume and stored normal agreement of each shell as it would be wound
+    std::vector<double> volume(num_shells, 0.0);
+    std::vector<double> vote(num_shells, 0.0);
+    std::vector<size_t> reversed(num_shells, 0);
+    std::vector<size_t> size(num_shells, 0);
+    std::vector<unsigned char> open(num_shells, 0);
+    for (size_t t=0; t<num_tris; ++t) {
+        const float *v = &positions[9*t];
+        const float *n = &normals[9*t];
+        double sign = parity[t] ? -1.0 : 1.0;
+        double a[3] = {v[3]-v[0], v[4]-v[1], v[5]-v[2]};
+        double b[3] = {v[6]-v[0], v[7]-v[1], v[8]-v[2]};
+        double c[3] = {a[1]*b[2] - a[2]*b[1],
+                       a[2]*b[0] - a[0]*b[2],
+                       a[0]*b[1] - a[1]*b[0]};
+        unsigned int s = parent[t];
+        volume[s] += sign*(v[0]*c[0] + v[1]*c[1] + v[2]*c[2]);
+        vote[s] += sign*(n[0]*c[0] + n[1]*c[1] + n[2]*c[2]);
+        reversed[s] += parity[t];
+        ++size[s];
+        for (size_t k=0; k<3; ++k) {
+            if (mate[3*t+k] >= MANY_MATES) {
+                open[s] = 1;
+            }
+        }
+    }
+    std::vector<unsigned int>().swap(mate);
+
+    // Ties keep whichever winding needs fewer facets reversed
+    std::vector<unsigned char> turn(num_shells, 0);
+    for (size_t s=0; s<num_shells; ++s) {
+        double score = open[s] ? vote[s] : volume[s];
+        turn[s] = score < 0.0 || (score == 0.0 && 2*reversed[s] > size[s]);
+        counts.open_shells += open[s];
+    }
+    counts.shells = num_shells;
+
+    long rewound = 0;
+    long renormalized = 0;
+#pragma omp parallel for reduction(+:rewound, renormalized)
+    for (long t=0; t<long(num_tris); ++t) {
+        float *v = &positions[9*t];
+        float *n = &normals[9*t];
+        if (parity[t] ^ turn[parent[t]]) {
+            float tmp[3];
+            std::memcpy(tmp, v+3, sizeof(tmp));
+            std::memcpy(v+3, v+6, sizeof(tmp));
+            std::memcpy(v+6, tmp, sizeof(tmp));
+            ++rewound;
+        }
+        float e1[3] = {v[3]-v[0], v[4]-v[1], v[5]-v[2]};
+        float e2[3] = {v[6]-v[0], v[7]-v[1], v[8]-v[2]};
+        float c[3] = {e1[1]*e2[2] - e1[2]*e2[1],
+                      e1[2]*e2[0] - e1[0]*e2[2],
+                      e1[0]*e2[1] - e1[1]*e2[0]};
+        float cc = c[0]*c[0] + c[1]*c[1] + c[2]*c[2];
+        float ee = (e1[0]*e1[0] + e1[1]*e1[1] + e1[2]*e1[2])*(e2[0]*e2[0] + e2[1]*e2[1] + e2[2]*e2[2]);
+        if (cc <= DEGENERATE_SIN*DEGENERATE_SIN*ee) {
+            continue;
+        }
+        float len = std::sqrt(cc);
+        c[0] /= len;
+        c[1] /= len;
+        c[2] /= len;
+        // Anything more than about 2.5 degrees off counts as a real change
+        float nn = n[0]*n[0] + n[1]*n[1] + n[2]*n[2];
+        float nc = n[0]*c[0] + n[1]*c[1] + n[2]*c[2];
+        if (nc <= 0.999f*std::sqrt(nn)) {
+            ++renormalized;
+        }
+        for (size_t k=0; k<3; ++k) {
+            std::memcpy(n + 3*k, c, sizeof(c));
+        }
+    }
+    counts.rewound = size_t(rewound);
+    counts.renormalized = size_t(renormalized);
+    return counts;
+}
+
+/*!
+  Encodes triangles [first, first+count) as binary STL records
+*/
+static void encode_binary(const float *positions, const float *normals,
+                          size_t first, size_t count, std::string &out) {
+    out.resize(count*BINARY_TRI_SIZE);
+    char *rec = &out[0];
+    for (size_t t=first; t<first+count; ++t, rec += BINARY_TRI_SIZE) {
+        std::memcpy(rec, normals + 9*t, sizeof(float)*3);
+        std::memcpy(rec + sizeof(float)*3, positions + 9*t, sizeof(float)*9);
+        rec[48] = rec[49] = 0;
+    }
+}
+
+/*!
+  Encodes triangles [first, first+count) as ASCII STL facets.
+  Nine significant digits are enough to read back the same floats.
+*/
+static void encode_ascii(const float *positions, const float *normals,
+                         size_t first, size_t count, std::string &out) {
+    out.clear();
+    out.reserve(count*300);
+    char buf[512];
+    for (size_t t=first; t<first+count; ++t) {
+        const float *n = normals + 9*t;
+        const float *v = positions + 9*t;
+        int len = std::sprintf(buf, "  facet normal %.8e %.8e %.8e\n    outer loop\n"
+                               "      vertex %.8e %.8e %.8e\n      vertex %.8e %.8e %.8e\n      vertex %.8e %.8e %.8e\n"
+                               "    endloop\n  endfacet\n",
+                               n[0], n[1], n[2], v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]);
+        // The GUI runs under the user's locale, where this could be "1,5"
+        use_c_decimal_point(buf, len);
+        out.append(buf, len);
+    }
+}
+
+/*!
+  Writes the mesh to fname, replacing it only once the whole file is written.
+
+  Chunks of triangles are encoded in parallel a round at a time.  While one
+  thread writes the previous round with large sequential writes, the others
+  encode the next one, so the disk rarely waits on encoding.  Memory use is
+  bounded by two rounds rather than the size of the whole file.
+*/
+void STLFile::save(std::string fname, bool binary) const {
+    const size_t num_tris = positions.size()/9;
+    if (binary && num_tris > 0xffffffffu) {
+        throw std::runtime_error("Too many triangles for a binary STL file.");
+    }
+
+    std::string tmp_fname = fname + ".tmp";
+    FILE *outf = std::fopen(tmp_fname.c_str(), "wb");
+    if (outf == NULL) {
+        throw std::runtime_error(std::string("Cannot write file ") + fname);
+    }
+
+    // Name ASCII solids after the file
+    std::string name = fname.substr(fname.find_last_of("/\\") + 1);
+    name = name.substr(0, name.rfind('.'));
+
+    bool ok = true;
+    if (binary) {
+        char hdr[80];
+        std::memcpy(hdr, header, sizeof(hdr));
+        // Other readers take any file starting with "solid" to be ASCII
+        if (0 == std::memcmp(hdr, "solid", 5)) {
+            std::memset(hdr, 0, sizeof(hdr));
+            std::strcpy(hdr, "binary STL");
+        }
+        uint32_t count = uint32_t(num_tris);
+        ok = (1 == std::fwrite(hdr, sizeof(hdr), 1, outf)) &&
+            (1 == std::fwrite(&count, sizeof(count), 1, outf));
+    } else {
+        std::string line = "solid " + name + "\n";
+        ok = line.size() == std::fwrite(line.data(), 1, line.size(), outf);
+    }
+
+    long round_chunks = 4;
+#ifdef _OPENMP
+    round_chunks = 2*omp_get_max_threads();
+#endif
+    const size_t num_chunks = (num_tris + SAVE_CHUNK_TRIS - 1)/SAVE_CHUNK_TRIS;
+    std::vector<std::string> encoded(round_chunks);
+    std::vector<std::string> writing(round_chunks);
+    const float *vp = getPositions();
+    const float *np = getNormals();
+    for (size_t round_start=0; ok && round_start < num_chunks + round_chunks; round_start += round_chunks) {
+#pragma omp parallel
+        {
+#pragma omp single nowait
+            for (long i=0; i<round_chunks && ok; ++i) {
+                ok = writing[i].size() == std::fwrite(writing[i].data(), 1, writing[i].size(), outf);
+            }
+#pragma omp for schedule(dynamic, 1)
+            for (long i=0; i<round_chunks; ++i) {
+                size_t chunk = round_start + i;
+                encoded[i].clear();
+                if (chunk < num_chunks) {
+                    size_t first = chunk*SAVE_CHUNK_TRIS;
+                    size_t count = std::min(SAVE_CHUNK_TRIS, num_tris - first);
+                    if (binary) {
+                        encode_binary(vp, np, first, count, encoded[i]);
+                    } else {
+                        encode_ascii(vp, np, first, count, encoded[i]);
+                    }
+                }
+            }
+        }
+        encoded.swap(writing);
+    }
+    if (ok && !binary) {
+        std::string line = "endsolid " + name + "\n";
+        ok = line.size() == std::fwrite(line.data(), 1, line.size(), outf);
+    }
+    ok = (0 == std::fclose(outf)) && ok;
+
+    if (ok) {
+        // rename won't replace an existing file on Windows
+        std::remove(fname.c_str());
+        ok = (0 == std::rename(tmp_fname.c_str(), fname.c_str()));
+    }
+    if (!ok) {
+        std::remove(tmp_fname.c_str());
+        throw std::runtime_error(std::string("Cannot write file ") + fname);
+    }
+}
+
+/*!
+  Loads the position and normal streams from a cache file written by write_cache.
+  Returns false, leaving the object empty, if the cache is missing, from a different
+  version, or doesn't match key.
+*/
+bool STLFile::read_cache(std::string cache_fname, const STLCacheKey &key) {
+    try {
+        MappedFile mf(cache_fname);
+        if (mf.size() < sizeof(CacheHeader)) {
+            return false;
+        }
+        CacheHeader hdr;
+        std::memcpy(&hdr, mf.data(), sizeof(hdr));
+        if (0 != std::memcmp(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+            hdr.version != CACHE_VERSION ||
+            hdr.source_size != key.source_size ||
+            hdr.source_mtime != key.source_mtime ||
+            hdr.content_hash != key.content_hash ||
+            hdr.path_hash != key.path_hash) {
+            return false;
+        }
+        size_t stream_bytes = size_t(hdr.num_tris)*9*sizeof(float);
+        if (mf.size() != hdr.data_offset + 2*stream_bytes) {
+            return false;
+        }
+
+        const float *data = (const float*)(mf.data() + hdr.data_offset);
+        positions.assign(data, data + 9*hdr.num_tris);
+        normals.assign(data + 9*hdr.num_tris, data + 18*hdr.num_tris);
+        std::memcpy(bounds_min, hdr.bounds_min, sizeof(bounds_min));
+        std::memcpy(bounds_max, hdr.bounds_max, sizeof(bounds_max));
+        std::memcpy(centroid, hdr.centroid, sizeof(centroid));
+        std::memcpy(sphere_center, hdr.sphere_center, sizeof(sphere_center));
+        sphere_radius = hdr.sphere_radius;
+        std::memcpy(header, hdr.stl_header, sizeof(header));
+        return true;
+    } catch (std::runtime_error &) {
+        return false;
+    }
+}
+
+/*!
+  Writes the position and normal streams, ready to hand to OpenGL, to a cache file.
+  Writes to a temporary file first so a half written cache is never picked up.
+*/
+bool STLFile::write_cache(std::string cache_fname, const STLCacheKey &key) const {
+    CacheHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    hdr.version = CACHE_VERSION;
+    hdr.data_offset = (sizeof(CacheHeader) + 63) & ~63u;
+    hdr.source_size = key.source_size;
+    hdr.source_mtime = key.source_mtime;
+    hdr.content_hash = key.content_hash;
+    hdr.path_hash = key.path_hash;
+    hdr.num_tris = positions.size()/9;
+    std::memcpy(hdr.bounds_min, bounds_min, sizeof(bounds_min));
+    std::memcpy(hdr.bounds_max, bounds_max, sizeof(bounds_max));
+    std::memcpy(hdr.centroid, centroid, sizeof(centroid));
+    std::memcpy(hdr.sphere_center, sphere_center, sizeof(sphere_center));
+    hdr.sphere_radius = sphere_radius;
+    std::memcpy(hdr.stl_header, header, sizeof(header));
+
+    std::string tmp_fname = cache_fname + ".tmp";
+    FILE *outf = std::fopen(tmp_fname.c_str(), "wb");
+    if (outf == NULL) {
+        return false;
+    }
+    char padding[64] = {0};
+    bool ok = (1 == std::fwrite(&hdr, sizeof(hdr), 1, outf)) &&
+        (hdr.data_offset - sizeof(hdr) == std::fwrite(padding, 1, hdr.data_offset - sizeof(hdr), outf)) &&
+        (positions.size() == std::fwrite(getPositions(), sizeof(float), positions.size(), outf)) &&
+        (normals.size() == std::fwrite(getNormals(), sizeof(float), normals.size(), outf));
+    ok = (0 == std::fclose(outf)) && ok;
+
+    if (ok) {
+        // rename won't replace an existing file on Windows
+        std::remove(cache_fname.c_str());
+        ok = (0 == std::rename(tmp_fname.c_str(), cache_fname.c_str()));
+    }
+    if (!ok) {
+        std::remove(tmp_fname.c_str());
     }
+    return ok;
 }
@@ -21,37 +21,135 @@
 
 #include <vector>
 #include <string>
-#include <cstring>
-struct Triangle {
-    float normal[3];
-    float verts[3*3];
-    
-    Triangle(float tr[12]) {
-        std::memcpy(normal, tr, sizeof(float)*3);
-        std::memcpy(verts, tr + 3, sizeof(float)*3*3);
+#include <stdexcept>
+
+// Binary STL layout: 80 byte header, 4 byte triangle count, then
+// 50 byte records of 12 floats and a 2 byte attribute count
+static const size_t BINARY_HEADER_SIZE = 84;
+static const size_t BINARY_TRI_SIZE = 50;
+
+/*!
+  Receives progress updates while an STLFile loads.
+  May be called from several threads, but never from more than one at a time.
+*/
+class STLProgress {
+public:
+    virtual ~STLProgress() {}
+    // Return false to cancel the load
+    virtual bool progress(size_t bytes_done, size_t bytes_total, size_t tris_done) = 0;
+
+    // Called with each batch of triangles as soon as it's decoded, for progressive display.
+    // Batches don't arrive in file order, and the pointers are only valid during the call.
+    virtual void trianglesDecoded(const float * /*positions*/, const float * /*normals*/,
+                                  size_t /*num_tris*/) {
     }
 };
 
-typedef std::vector<Triangle> tri_vect_t;
+/*!
+  Thrown from the STLFile constructor when an STLProgress cancels the load
+*/
+class STLLoadCancelled : public std::runtime_error {
+public:
+    STLLoadCancelled() : std::runtime_error("Load cancelled") {}
+};
+
+/*!
+  Identifies the exact version of a source file that a cache file was made from
+*/
+struct STLCacheKey {
+    unsigned long long source_size;
+    long long source_mtime;
+    unsigned long long content_hash;
+    unsigned long long path_hash;
+};
+
+// Per facet results of STLFile::checkNormals
+enum NormalCheck {
+    NORMAL_OK = 0,
+    // The stored normal points against the one from the winding order
+    NORMAL_FLIPPED = 1,
+    // No area, so the winding doesn't give a normal
+    NORMAL_DEGENERATE = 2,
+    // The stored normal is all zeros, which some exporters write
+    NORMAL_UNSET = 3
+};
+
+struct NormalCheckCounts {
+    size_t flipped;
+    size_t degenerate;
+    size_t unset;
+};
+
+// What STLFile::repairNormals changed and found
+struct NormalRepairCounts {
+    // Facets whose corner order was reversed
+    size_t rewound;
+    // Facets whose stored normal was replaced by a noticeably different one
+    size_t renormalized;
+    // Edge connected pieces of the mesh, and how many of them have holes
+    size_t shells;
+    size_t open_shells;
+    // Shared edges that can't be wound consistently, like on a Mobius strip
+    size_t conflicts;
+};
 
 class STLFile {
 public:
     STLFile();
-    STLFile(std::string fname);
+    // With a cache_dir, a valid cache of fname is loaded instead of parsing,
+    // and a new cache is written after parsing
+    STLFile(std::string fname, STLProgress *progress = 0, std::string cache_dir = "");
     ~STLFile();
     // void draw();
-    void fillBuffers(size_t max_tris, float *verts, float *norms, unsigned int *indices);
-    size_t getNumTris();
-    float getBoundingRadius();
+    size_t buildIndexedMesh(float epsilon, std::vector<float> &verts,
+                            std::vector<float> &norms, std::vector<unsigned int> &indices);
+    size_t getNumTris() const;
+    // Radius of a sphere around getCenter() that holds every vertex
+    float getBoundingRadius() const;
+    // Center of the bounding sphere, which is what the viewer looks at
+    void getCenter(float center[3]) const;
+    // Mean of all the corners
+    void getCentroid(float centroid[3]) const;
+    void getBounds(float min[3], float max[3]) const;
+    double getSurfaceArea() const;
+    // Enclosed volume, only meaningful for closed, consistently wound meshes
+    double getVolume() const;
+    // Compares each stored normal with the winding order, one NormalCheck per facet
+    NormalCheckCounts checkNormals(std::vector<unsigned char> &flags) const;
+    // Makes the winding consistent across each shell, turns closed shells
+    // outward and recomputes every normal from the winding
+    NormalRepairCounts repairNormals();
+
+    // Writes the mesh as a binary or ASCII STL file.
+    // Throws std::runtime_error if the file can't be written.
+    void save(std::string fname, bool binary = true) const;
+
+    // Three corners per triangle, xyz per corner
+    const float *getPositions() const;
+    // The facet normal, repeated for each corner so it lines up with getPositions()
+    const float *getNormals() const;
 
 private:
-    void read_ascii_file(FILE *inf);
-    void read_binary_file(FILE *inf);
+    void read_ascii_file(const char *data, size_t size, STLProgress *progress);
+    void read_binary_file(const char *data, size_t size, STLProgress *progress);
+    bool read_cache(std::string cache_fname, const STLCacheKey &key);
+    bool write_cache(std::string cache_fname, const STLCacheKey &key) const;
+    void computeBounds();
+    size_t weldPositions(float epsilon, std::vector<float> &verts,
+                         std::vector<unsigned int> &indices) const;
     
 private:
-    tri_vect_t tris;
+    // Stored in the layout glVertexPointer/glNormalPointer expect,
+    // so the viewer can draw straight from them without another copy
+    std::vector<float> positions;
+    std::vector<float> normals;
     char header[80];
-    float most_extreme_point[3];
+    // Filled in by computeBounds once the whole mesh is loaded
+    float bounds_min[3];
+    float bounds_max[3];
+    float centroid[3];
+    float sphere_center[3];
+    float sphere_radius;
 };
 
 #endif
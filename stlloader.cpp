@@ -0,0 +1,129 @@
+/*
+  stlloader.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QFile>
+
+#include "stlloader.h"
+#include "profiler.h"
+
+// Minimum time between progress signals, in milliseconds
+static const qint64 REPORT_INTERVAL = 100;
+
+STLLoader::STLLoader(QString fileName, QObject *parent) : QThread(parent), fname(fileName), stlf(0),
+                                                          cancelRequested(false), cancelled(false),
+                                                          streaming(false) {
+}
+
+/*!
+  Cancels and waits for the load if it's still running
+*/
+STLLoader::~STLLoader() {
+    cancel();
+    wait();
+    delete stlf;
+}
+
+QString STLLoader::fileName() const {
+    return fname;
+}
+
+STLFile *STLLoader::takeFile() {
+    STLFile *tmp = stlf;
+    stlf = 0;
+    return tmp;
+}
+
+QString STLLoader::errorString() const {
+    return error;
+}
+
+bool STLLoader::wasCancelled() const {
+    return cancelled;
+}
+
+/*!
+  Must be called before start()
+*/
+void STLLoader::setCacheDir(QString dir) {
+    cacheDir = dir;
+}
+
+/*!
+  Can be turned off while loading to stop queueing batches nobody will draw
+*/
+void STLLoader::setStreaming(bool stream) {
+    streaming = stream;
+}
+
+void STLLoader::takeBatches(std::vector<float> &positions, std::vector<float> &normals) {
+    QMutexLocker lock(&batchMutex);
+    if (positions.empty()) {
+        positions.swap(batchPositions);
+        normals.swap(batchNormals);
+    } else {
+        positions.insert(positions.end(), batchPositions.begin(), batchPositions.end());
+        normals.insert(normals.end(), batchNormals.begin(), batchNormals.end());
+        batchPositions.clear();
+        batchNormals.clear();
+    }
+}
+
+/*!
+  Asks the load to stop.  It stops at the next progress check.
+*/
+void STLLoader::cancel() {
+    cancelRequested = true;
+}
+
+void STLLoader::run() {
+    ProfileScope profile("parse");
+    sinceReport.start();
+    try {
+        stlf = new STLFile(QFile::encodeName(fname).constData(), this,
+                           QFile::encodeName(cacheDir).constData());
+    } catch (STLLoadCancelled &) {
+        cancelled = true;
+    } catch (std::runtime_error &re) {
+        error = QString(re.what());
+    } catch (std::bad_alloc &) {
+        error = tr("Not enough memory to load %1").arg(fname);
+    }
+}
+
+/*!
+  Called by STLFile while parsing, possibly from one of its worker threads
+*/
+bool STLLoader::progress(size_t bytes_done, size_t bytes_total, size_t tris_done) {
+    if (bytes_done == bytes_total || sinceReport.elapsed() >= REPORT_INTERVAL) {
+        sinceReport.restart();
+        emit loadProgress(qint64(bytes_done), qint64(bytes_total), qint64(tris_done));
+    }
+    return !cancelRequested;
+}
+
+/*!
+  Queues a copy of each decoded batch until the viewer picks it up with takeBatches()
+*/
+void STLLoader::trianglesDecoded(const float *positions, const float *normals, size_t num_tris) {
+    if (!streaming) {
+        return;
+    }
+    QMutexLocker lock(&batchMutex);
+    batchPositions.insert(batchPositions.end(), positions, positions + 9*num_tris);
+    batchNormals.insert(batchNormals.end(), normals, normals + 9*num_tris);
+}
@@ -0,0 +1,85 @@
+/*
+  stlloader.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef STL_LOADER_HEADER
+#define STL_LOADER_HEADER
+
+#include <QThread>
+#include <QString>
+#include <QElapsedTimer>
+#include <QMutex>
+
+#include <vector>
+
+#include "stlfile.h"
+
+/*!
+  Loads an STLFile on a worker thread so the GUI stays responsive.
+  Emits loadProgress while parsing, then QThread::finished when done.
+  The caller takes ownership of the result with takeFile().
+*/
+class STLLoader : public QThread, private STLProgress {
+    Q_OBJECT;
+
+public:
+    STLLoader(QString fileName, QObject *parent = 0);
+    ~STLLoader();
+
+    QString fileName() const;
+
+    // Only valid after the thread has finished
+    STLFile *takeFile();
+    QString errorString() const;
+    bool wasCancelled() const;
+
+    // Directory for render-ready cache files, empty to disable caching
+    void setCacheDir(QString dir);
+
+    // Keep copies of decoded triangles so they can be drawn before the load finishes
+    void setStreaming(bool stream);
+    // Moves every triangle decoded since the last call onto the end of positions/normals
+    void takeBatches(std::vector<float> &positions, std::vector<float> &normals);
+
+public slots:
+    void cancel();
+
+signals:
+    void loadProgress(qint64 bytesDone, qint64 bytesTotal, qint64 trisDone);
+
+protected:
+    void run();
+
+private:
+    bool progress(size_t bytes_done, size_t bytes_total, size_t tris_done);
+    void trianglesDecoded(const float *positions, const float *normals, size_t num_tris);
+
+    QString fname;
+    QString cacheDir;
+    STLFile *stlf;
+    QString error;
+    volatile bool cancelRequested;
+    bool cancelled;
+    QElapsedTimer sinceReport;
+
+    volatile bool streaming;
+    QMutex batchMutex;
+    std::vector<float> batchPositions;
+    std::vector<float> batchNormals;
+};
+
+#endif
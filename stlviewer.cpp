@@ -18,10 +18,16 @@
 
 #include <QMainWindow>
 
+#include <climits>
+#include <cfloat>
+#include <algorithm>
+
 #include <sstream>
 #include <stdexcept>
 
 #include "stlviewer.h"
+#include "stlloader.h"
+#include "lodbuilder.h"
 
 void cross(const float a[3], const float b[3], float res[3]) {
     /*
@@ -49,251 +55,475 @@ void normalize(float a[3]) {
 */
 STLViewer::STLViewer(QWidget*) : stlf(new STLFile()), rotationX(0.0), rotationY(0.0),
                                  rotationZ(0.0), translate(250.0),
-                                 num_tris(0), verts(0), norms(0), indices(0), showPolygons(true), showFacets(true), showNorms(true) {
+                                 num_tris(0), showPolygons(true), showFacets(true), showNorms(true),
+                                 weldVertices(false), highlightNormals(false),
+                                 vertexBuffer(QGLBuffer::VertexBuffer), normalBuffer(QGLBuffer::VertexBuffer),
+                                 indexBuffer(QGLBuffer::IndexBuffer), normLineBuffer(QGLBuffer::VertexBuffer),
+                                 useBuffers(false),
+                                 allowBuffers(qgetenv("STLVIEWER_NO_VBO").isEmpty()),
+                                 compactStorage(false), compactBuffers(false),
+                                 visibleTris(0), lodBuilder(0), dragging(false),
+                                 inputPending(false), pendingEvents(0),
+                                 interactionFrames(0), interactionEvents(0),
+                                 latencyTotal(0.0), latencyWorst(0.0), detailRung(0), drawnRung(0), renderMs(0.0),
+                                 flippedBuffer(QGLBuffer::VertexBuffer), degenerateBuffer(QGLBuffer::VertexBuffer),
+                                 numFlipped(0), numDegenerate(0),
+                                 bvh(0), pickedTri(-1), loader(0),
+                                 progressiveLoad(true) {
+    std::fill(streamMin, streamMin+3, FLT_MAX);
+    std::fill(streamMax, streamMax+3, -FLT_MAX);
+    streamTimer = new QTimer(this);
+    streamTimer->setInterval(STREAM_REPAINT_INTERVAL);
+    connect(streamTimer, SIGNAL(timeout()), this, SLOT(pollStream()));
+
+    frameTimer = new QTimer(this);
+    frameTimer->setSingleShot(true);
+    connect(frameTimer, SIGNAL(timeout()), this, SLOT(frameDue()));
+    zoomTimer = new QTimer(this);
+    zoomTimer->setSingleShot(true);
+    zoomTimer->setInterval(ZOOM_SETTLE_INTERVAL);
+    connect(zoomTimer, SIGNAL(timeout()), this, SLOT(finishInteraction()));
+
+    int refreshRate = DEFAULT_REFRESH_RATE;
+#if QT_VERSION >= 0x050000
+    if (QGuiApplication::primaryScreen() && QGuiApplication::primaryScreen()->refreshRate() >= 1.0) {
+        refreshRate = int(QGuiApplication::primaryScreen()->refreshRate() + 0.5);
+    }
+#endif
+    frameInterval = std::max(1, 1000/refreshRate);
+
     QGLFormat theFormat(QGL::DoubleBuffer | QGL::DepthBuffer | QGL::SampleBuffers);
     theFormat.setSamples(2);
+    // Swap on vertical retrace, so frames line up with the ones the scheduler paces
+    theFormat.setSwapInterval(1);
     setFormat(theFormat);
+
+    // Setting STLVIEWER_PROFILE profiles from the start, so the first load is timed too
+    if (!qgetenv("STLVIEWER_PROFILE").isEmpty()) {
+        Profiler::setEnabled(true);
+    }
 }
 
 /*!
   Frees memory and cleans up OpenGL state
 */
 STLViewer::~STLViewer() {
-    for (size_t i=1;i<NUM_LISTS; ++i) {
+    clearStream();
+    clearLOD();
+    delete bvh;
+    makeCurrent();
+    glTimer.destroy();
+    for (size_t i=0;i<NUM_LISTS; ++i) {
         glDeleteLists(dispLists[i], 1);
     }
-    if (verts) {
-        delete [] verts;
-        verts = 0;
-    }
-    if (norms) {
-        delete [] norms;
-        norms = 0;
-    }
-    if (indices) {
-        delete [] indices;
-        indices = 0;
-    }
     if (stlf) {
         delete stlf;
         stlf = 0;
     }
 }
 
-/*!
-  Loads the material arrays
-*/
-void STLViewer::initMaterials() {
-    // lines
-    mat_specular[LINE_MAT][0]=0.0f;
-    mat_specular[LINE_MAT][1]=0.0f;
-    mat_specular[LINE_MAT][2]=0.0f;
-    mat_specular[LINE_MAT][3]=1.0f;
-  
-    mat_shininess[LINE_MAT][0]=80.0f;
-
-    mat_diffuse[LINE_MAT][0]=0.0f;
-    mat_diffuse[LINE_MAT][1]=0.0f;
-    mat_diffuse[LINE_MAT][2]=0.0f;
-    mat_diffuse[LINE_MAT][3]=1.0f;
-  
-    mat_ambient[LINE_MAT][0] = 0.0f;
-    mat_ambient[LINE_MAT][1] = 0.0f;
-    mat_ambient[LINE_MAT][2] = 0.0f;
-    mat_ambient[LINE_MAT][3] = 1.0f;
-
-    // closed spots
-    mat_specular[SURF_MAT][0]=1.0f;
-    mat_specular[SURF_MAT][1]=1.0f;
-    mat_specular[SURF_MAT][2]=1.0f;
-    mat_specular[SURF_MAT][3]=1.0f;
-
-    mat_shininess[SURF_MAT][0]=100.0f;
-  
-    mat_diffuse[SURF_MAT][0]=0.0f;
-    mat_diffuse[SURF_MAT][1]=0.0f;
-    mat_diffuse[SURF_MAT][2]=1.0f;
-    mat_diffuse[SURF_MAT][3]=1.0f;
-  
-    mat_ambient[SURF_MAT][0] = 0.10f;
-    mat_ambient[SURF_MAT][1] = 0.10f;
-    mat_ambient[SURF_MAT][2] = 0.10f;
-    mat_ambient[SURF_MAT][3] = 1.0f;
-}
-
-/*!
-  Initializes the light arrays
-*/
-void STLViewer::initLights() {
-    light_position[0][0]=0.0f;
-    light_position[0][1]=0.0f;
-    light_position[0][2]=30.0f;
-    light_position[0][3]=1.0f;
-  
-    light_position[1][0]=0.0f;
-    light_position[1][1]=0.0f;
-    light_position[1][2]=-30.0f;
-    light_position[1][3]=1.0f;
-  
-    for (size_t i=0;i<NUM_LIGHTS; ++i) {
-        light_color[i][0]=1.0f;
-        light_color[i][1]=1.0f;
-        light_color[i][2]=1.0f;
-        light_color[i][3]=1.0f;
-        lmodel_ambient[i][0]=0.4f;
-        lmodel_ambient[i][1]=0.4f;
-        lmodel_ambient[i][2]=0.4f;
-        lmodel_ambient[i][3]=1.0f;
-    }
-
-    glEnable(GL_LIGHTING);
-    
-    glEnable(GL_LIGHT0);
-    glEnable(GL_LIGHT1);
-}
-
 /*!
   Initializes the display lists
 */
 void STLViewer::initLists() {
-    dispLists[0] = glGenLists(1);
+    for (size_t i=0;i<NUM_LISTS; ++i) {
+        dispLists[i] = glGenLists(1);
+    }
     // glNewList(dispLists[0], GL_COMPILE);
     // drawBoxList(1);
     // glEndList();
 }
 
 void STLViewer::regenList() {
+    ProfileScope profile("regenList");
     glDeleteLists(dispLists[0], 1);
-    glDeleteLists(dispLists[1], 1);
-    glDeleteLists(dispLists[2], 1);
-
     dispLists[0] = glGenLists(1);
-    dispLists[1] = glGenLists(1);
-    dispLists[2] = glGenLists(1);
-    
+    useBuffers = false;
+    clusters.clear();
+    visibleRuns.clear();
+    normLineBuffer.destroy();
+    std::vector<float>().swap(normLines);
     
     if (stlf) {
-        if (verts) {
-            delete [] verts;
-            verts = 0;
-        }
-        if (norms) {
-            delete [] norms;
-            norms = 0;
-        }
-        if (indices) {
-            delete [] indices;
-            indices = 0;
+        num_tris = stlf->getNumTris();
+        if (weldVertices) {
+            ProfileScope profileWeld("weld vertices");
+            QElapsedTimer timer;
+            timer.start();
+            // Tiny relative to the model, so only vertices that should be shared are merged
+            float epsilon = 1.0e-6f*stlf->getBoundingRadius();
+            size_t num_unique = stlf->buildIndexedMesh(epsilon, verts, norms, indices);
+            emit statusMessage(tr("Welded %1 vertices into %2 in %3 ms")
+                               .arg(3*num_tris).arg(num_unique).arg(timer.elapsed()));
+        } else {
+            // Draw straight from the file's buffers
+            std::vector<float>().swap(verts);
+            std::vector<float>().swap(norms);
+            std::vector<unsigned int>().swap(indices);
         }
 
-        num_tris = stlf->getNumTris();
-        verts = new float[num_tris*3*3];
-        norms = new float[num_tris*3*3];
-        indices = new unsigned int[num_tris*3];
+        if (num_tris == 0) {
+            return;
+        }
 
-        stlf->fillBuffers(num_tris, verts, norms, indices);
+        const float *vp = weldVertices ? &verts[0] : stlf->getPositions();
+        const float *np = weldVertices ? &norms[0] : stlf->getNormals();
 
+        useBuffers = uploadBuffers(vp, np);
 
         glEnableClientState( GL_VERTEX_ARRAY);
         glEnableClientState(GL_NORMAL_ARRAY);
-        glNewList(dispLists[0], GL_COMPILE);        
 
+        // Only needed when the driver can't do vertex buffer objects
+        if (!useBuffers) {
+            GLProfileScope profileList(glTimer, "compile display list");
+            glNewList(dispLists[0], GL_COMPILE);        
+            glVertexPointer( 3, GL_FLOAT, 0, vp );
+            glNormalPointer( GL_FLOAT, 0, np );
+            if (weldVertices) {
+                glDrawElements( GL_TRIANGLES, 3*num_tris, GL_UNSIGNED_INT, &indices[0]);
+            } else {
+                glDrawArrays( GL_TRIANGLES, 0, 3*num_tris);
+            }
+            glEndList();
+        }
 
-        glVertexPointer( 3, GL_FLOAT, 0, verts );
-        glNormalPointer( GL_FLOAT, 0, norms );
-        glDrawElements( GL_TRIANGLES, 3*num_tris, GL_UNSIGNED_INT, indices);
-        glEndList();
+        buildNormalLines(vp);
 
-        
-        glNewList(dispLists[1], GL_COMPILE);
-        glLineWidth(1.5);
-        for (size_t i=0;i<num_tris;++i) {
-            glDrawElements( GL_LINE_LOOP, 3, GL_UNSIGNED_INT, indices+3*i);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+    }
+
+}
+/*!
+  Copies the mesh into vertex buffer objects so it only crosses the bus once.
+  The triangles are stored in spatial cluster order so drawMesh can skip the
+  clusters outside the view.
+  With compact storage, positions are quantized to GLshorts and normals to
+  GLbytes on the way, cutting 24 bytes per vertex down to 9.
+  Returns false if buffer objects aren't available or the mesh is too large
+  for them, in which case the caller falls back to display lists.
+*/
+bool STLViewer::uploadBuffers(const float *vp, const float *np) {
+    GLProfileScope profile(glTimer, "uploadBuffers");
+    vertexBuffer.destroy();
+    normalBuffer.destroy();
+    indexBuffer.destroy();
+    compactBuffers = false;
+
+    if (!allowBuffers) {
+        return false;
+    }
+
+    const bool compact = compactStorage;
+    const int posSize = compact ? 3*sizeof(GLshort) : 3*sizeof(float);
+    const int normSize = compact ? 3*sizeof(GLbyte) : 3*sizeof(float);
+    qint64 numVerts = weldVertices ? qint64(verts.size()/3) : qint64(3*num_tris);
+    qint64 vertBytes = numVerts*posSize;
+    qint64 normBytes = numVerts*normSize;
+    qint64 indexBytes = weldVertices ? qint64(indices.size()*sizeof(unsigned int)) : 0;
+    // QGLBuffer sizes are ints
+    if (vertBytes > INT_MAX || indexBytes > INT_MAX) {
+        return false;
+    }
+
+    if (!vertexBuffer.create() || !normalBuffer.create()) {
+        vertexBuffer.destroy();
+        normalBuffer.destroy();
+        return false;
+    }
+    if (weldVertices && !indexBuffer.create()) {
+        vertexBuffer.destroy();
+        normalBuffer.destroy();
+        return false;
+    }
+
+    std::vector<unsigned int> order;
+    {
+        ProfileScope profileClusters("buildClusters");
+        buildClusters(vp, weldVertices ? &indices[0] : 0, num_tris, CLUSTER_TRIS, order, clusters);
+    }
+
+    QuantizeError quantError = {0.0f, 0.0f};
+    if (compact) {
+        float bmin[3], bmax[3];
+        stlf->getBounds(bmin, bmax);
+        quantizeFrame(bmin, bmax, quantFrame);
+    }
+
+    vertexBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+    normalBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+    if (weldVertices) {
+        // Shared vertices stay put, only the index triangles are reordered
+        std::vector<unsigned int> sorted(indices.size());
+        {
+            ProfileScope profileFill("fill buffers");
+#pragma omp parallel for
+            for (long i=0; i<long(num_tris); ++i) {
+                const unsigned int *tri = &indices[3*size_t(order[i])];
+                sorted[3*i] = tri[0];
+                sorted[3*i+1] = tri[1];
+                sorted[3*i+2] = tri[2];
+            }
+        }
+        indices.swap(sorted);
+
+        if (compact) {
+            std::vector<GLshort> qverts(3*size_t(numVerts));
+            std::vector<GLbyte> qnorms(3*size_t(numVerts));
+            {
+                ProfileScope profileFill("fill buffers");
+                quantizeVertices(quantFrame, vp, np, size_t(numVerts), &qverts[0], &qnorms[0], quantError);
+            }
+            vertexBuffer.bind();
+            vertexBuffer.allocate(&qverts[0], int(vertBytes));
+            normalBuffer.bind();
+            normalBuffer.allocate(&qnorms[0], int(normBytes));
+        } else {
+            vertexBuffer.bind();
+            vertexBuffer.allocate(vp, int(vertBytes));
+            normalBuffer.bind();
+            normalBuffer.allocate(np, int(normBytes));
+        }
+        normalBuffer.release();
+    } else {
+        // Gathered a chunk at a time so there's never a second copy of the whole mesh
+        vertexBuffer.bind();
+        vertexBuffer.allocate(int(vertBytes));
+        normalBuffer.bind();
+        normalBuffer.allocate(int(normBytes));
+        std::vector<float> vchunk(9*std::min(num_tris, UPLOAD_CHUNK_TRIS));
+        std::vector<float> nchunk(vchunk.size());
+        std::vector<GLshort> qvchunk(compact ? vchunk.size() : 0);
+        std::vector<GLbyte> qnchunk(compact ? vchunk.size() : 0);
+        for (size_t first=0; first<num_tris; first+=UPLOAD_CHUNK_TRIS) {
+            long count = long(std::min(UPLOAD_CHUNK_TRIS, num_tris - first));
+            const void *vdata = &vchunk[0];
+            const void *ndata = &nchunk[0];
+            {
+                ProfileScope profileFill("fill buffers");
+#pragma omp parallel for
+                for (long i=0; i<count; ++i) {
+                    size_t src = 9*size_t(order[first+i]);
+                    std::copy(vp + src, vp + src + 9, &vchunk[9*i]);
+                    std::copy(np + src, np + src + 9, &nchunk[9*i]);
+                }
+                if (compact) {
+                    quantizeVertices(quantFrame, &vchunk[0], &nchunk[0], 3*size_t(count),
+                                     &qvchunk[0], &qnchunk[0], quantError);
+                    vdata = &qvchunk[0];
+                    ndata = &qnchunk[0];
+                }
+            }
+            vertexBuffer.bind();
+            vertexBuffer.write(int(3*first)*posSize, vdata, int(3*count)*posSize);
+            normalBuffer.bind();
+            normalBuffer.write(int(3*first)*normSize, ndata, int(3*count)*normSize);
         }
-        glEndList();
+        normalBuffer.release();
+    }
+    compactBuffers = compact;
+    if (compact) {
+        double fullBytes = double(numVerts)*6*sizeof(float);
+        double radius = stlf->getBoundingRadius();
+        emit statusMessage(tr("Compact storage: %1 MB instead of %2 MB, positions within %3 (%4% of the model size), normals within %5 degrees")
+                           .arg((vertBytes + normBytes)/(1024.0*1024.0), 0, 'f', 1)
+                           .arg(fullBytes/(1024.0*1024.0), 0, 'f', 1)
+                           .arg(quantError.position, 0, 'g', 3)
+                           .arg(radius > 0.0 ? 100.0*quantError.position/radius : 0.0, 0, 'g', 2)
+                           .arg(quantError.normal, 0, 'f', 2));
+    }
 
+    if (weldVertices) {
+        indexBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+        indexBuffer.bind();
+        indexBuffer.allocate(&indices[0], int(indexBytes));
+        indexBuffer.release();
+    }
+    return true;
+}
 
-        glNewList(dispLists[2], GL_COMPILE);
-        glLineWidth(1.0);
-        float ot = 1.0/3.0;
-        
-        float nVerts[6] = {0.0f};
-        int lineIdx[2] = {0, 1};
-        for (size_t i=0;i<3*num_tris;++i) {
-            nVerts[0] =
-                ot * verts[3*(i+0)] +
-                ot * verts[3*(i+1)] +
-                ot * verts[3*(i+2)];
-            nVerts[1] =
-                ot * verts[3*(i+0)+1] +
-                ot * verts[3*(i+1)+1] +
-                ot * verts[3*(i+2)+1];
-            nVerts[2] =
-                ot * verts[3*(i+0)+2] +
-                ot * verts[3*(i+1)+2] +
-                ot * verts[3*(i+2)+2];
-
-            float p1[3] = {verts[3*(i+1)+0] - verts[3*i+0],
-                           verts[3*(i+1)+1] - verts[3*i+1],
-                           verts[3*(i+1)+2] - verts[3*i+2]};
-
-            float p2[3] = {verts[3*(i+2)+0] - verts[3*(i+1)+0],
-                           verts[3*(i+2)+1] - verts[3*(i+1)+1],
-                           verts[3*(i+2)+2] - verts[3*(i+1)+2]};
-                           
-            float res[3];
-            normalize(p1);
-            normalize(p2);
-            cross(p1,p2, res);
-            // normalize(res);
-                
-            // nVerts[3] = nVerts[0] + ot*norms[3*(3*i+0)];
-            // nVerts[4] = nVerts[1] + ot*norms[3*(3*i+1)];
-            // nVerts[5] = nVerts[2] + ot*norms[3*(3*i+2)];
-            nVerts[3] = nVerts[0] + ot*res[0];
-            nVerts[4] = nVerts[1] + ot*res[1];
-            nVerts[5] = nVerts[2] + ot*res[2];
-            
-            // qDebug() << nVerts[0] << nVerts[1] << nVerts[2] << " to "
-            //          << nVerts[3] << nVerts[4] << nVerts[5];
-            // nVerts[3] = 0.0f;
-            // nVerts[4] = 0.0f;
-            // nVerts[5] = 0.0f;
-
-            glVertexPointer( 3, GL_FLOAT, 0, nVerts );
-            glDrawElements( GL_LINES, 2, GL_UNSIGNED_INT, lineIdx);
+/*!
+  Finds the runs of clusters inside the view frustum for this frame.
+  Neighbouring visible clusters are merged so they draw with one call.
+*/
+void STLViewer::cullClusters() {
+    ProfileScope profile("cullClusters");
+    visibleRuns.clear();
+    visibleTris = num_tris;
+    if (clusters.empty()) {
+        return;
+    }
+    visibleTris = 0;
+    GLfloat proj[16];
+    GLfloat model[16];
+    GLfloat clip[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, proj);
+    glGetFloatv(GL_MODELVIEW_MATRIX, model);
+    for (size_t col=0; col<4; ++col) {
+        for (size_t row=0; row<4; ++row) {
+            clip[4*col+row] = proj[row]*model[4*col] + proj[4+row]*model[4*col+1] +
+                proj[8+row]*model[4*col+2] + proj[12+row]*model[4*col+3];
         }
-        glEndList();
+    }
+    float planes[6][4];
+    extractFrustum(clip, planes);
 
-        glDisableClientState(GL_NORMAL_ARRAY);
+    for (size_t i=0; i<clusters.size(); ++i) {
+        const MeshCluster &cluster = clusters[i];
+        if (!boxInFrustum(planes, cluster.bmin, cluster.bmax)) {
+            continue;
+        }
+        visibleTris += cluster.count;
+        if (!visibleRuns.empty() &&
+            visibleRuns.back().first + visibleRuns.back().second == cluster.first) {
+            visibleRuns.back().second += cluster.count;
+        } else {
+            visibleRuns.push_back(std::make_pair(cluster.first, cluster.count));
+        }
+    }
+}
+
+/*!
+  Draws the mesh triangles, from buffer objects if they're in use.
+  With buffer objects only the clusters found by cullClusters are drawn.
+  The facet outlines are the same triangles drawn with glPolygonMode(GL_LINE).
+*/
+void STLViewer::drawMesh() {
+    if (!useBuffers) {
+        glCallList(dispLists[0]);
+        return;
+    }
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+
+    if (compactBuffers) {
+        // Positions are decoded by the modelview matrix, and the byte normals
+        // are only approximately unit length
+        glPushMatrix();
+        glTranslatef(quantFrame.center[0], quantFrame.center[1], quantFrame.center[2]);
+        glScalef(quantFrame.scale, quantFrame.scale, quantFrame.scale);
+        glEnable(GL_NORMALIZE);
+        vertexBuffer.bind();
+        glVertexPointer(3, GL_SHORT, 0, 0);
+        normalBuffer.bind();
+        glNormalPointer(GL_BYTE, 0, 0);
+    } else {
+        vertexBuffer.bind();
+        glVertexPointer(3, GL_FLOAT, 0, 0);
+        normalBuffer.bind();
+        glNormalPointer(GL_FLOAT, 0, 0);
+    }
+    normalBuffer.release();
+
+    if (weldVertices) {
+        indexBuffer.bind();
+    }
+    for (size_t i=0; i<visibleRuns.size(); ++i) {
+        size_t first = visibleRuns[i].first;
+        size_t count = visibleRuns[i].second;
+        if (weldVertices) {
+            glDrawElements(GL_TRIANGLES, GLsizei(3*count), GL_UNSIGNED_INT,
+                           (const GLvoid*)(3*first*sizeof(unsigned int)));
+        } else {
+            glDrawArrays(GL_TRIANGLES, GLint(3*first), GLsizei(3*count));
+        }
+    }
+    if (weldVertices) {
+        indexBuffer.release();
+    }
+    if (compactBuffers) {
+        glDisable(GL_NORMALIZE);
+        glPopMatrix();
+    }
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+/*!
+  Fills normLines with one segment per facet, from its centroid out along its
+  winding normal.  Glyph length scales with the model so they stay readable.
+*/
+void STLViewer::buildNormalLines(const float *vp) {
+    ProfileScope profile("buildNormalLines");
+    normLineBuffer.destroy();
+    normLines.resize(6*num_tris);
+    const float len = 0.02f*stlf->getBoundingRadius();
+    const float ot = 1.0f/3.0f;
+
+#pragma omp parallel for
+    for (long i=0;i<long(num_tris);++i) {
+        const float *v0 = vp + 3*corner(i, 0);
+        const float *v1 = vp + 3*corner(i, 1);
+        const float *v2 = vp + 3*corner(i, 2);
+        float *line = &normLines[6*i];
+        line[0] = ot * (v0[0] + v1[0] + v2[0]);
+        line[1] = ot * (v0[1] + v1[1] + v2[1]);
+        line[2] = ot * (v0[2] + v1[2] + v2[2]);
+
+        float p1[3] = {v1[0] - v0[0],
+                       v1[1] - v0[1],
+                       v1[2] - v0[2]};
+        float p2[3] = {v2[0] - v1[0],
+                       v2[1] - v1[1],
+                       v2[2] - v1[2]};
+        float res[3];
+        cross(p1, p2, res);
+        // normalize() leaves short vectors alone, which is most of them on a fine mesh
+        float rlen = length(res);
+        float scale = (rlen > 0.0f) ? len/rlen : 0.0f;
+
+        line[3] = line[0] + scale*res[0];
+        line[4] = line[1] + scale*res[1];
+        line[5] = line[2] + scale*res[2];
+    }
+
+    qint64 bytes = qint64(normLines.size()*sizeof(float));
+    if (useBuffers && bytes <= INT_MAX && normLineBuffer.create()) {
+        normLineBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+        normLineBuffer.bind();
+        normLineBuffer.allocate(&normLines[0], int(bytes));
+        normLineBuffer.release();
+        // The GPU has its own copy now
+        std::vector<float>().swap(normLines);
+    }
+}
+
+/*!
+  Draws all of the normal glyphs with one call
+*/
+void STLViewer::drawNormals() {
+    GLProfileScope profile(glTimer, "drawNormals");
+    glEnableClientState(GL_VERTEX_ARRAY);
+    if (normLineBuffer.isCreated()) {
+        normLineBuffer.bind();
+        glVertexPointer(3, GL_FLOAT, 0, 0);
+        normLineBuffer.release();
+    } else if (!normLines.empty()) {
+        glVertexPointer(3, GL_FLOAT, 0, &normLines[0]);
+    } else {
         glDisableClientState(GL_VERTEX_ARRAY);
+        return;
     }
+    glLineWidth(1.0);
+    glDrawArrays(GL_LINES, 0, 2*num_tris);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
 
+/*!
+  Index of the k'th corner of triangle tri in the vertex arrays being drawn
+*/
+inline size_t STLViewer::corner(size_t tri, size_t k) const {
+    return weldVertices ? indices[3*tri+k] : 3*tri+k;
 }
+
 /*!
   Initializes OpenGL by enabling required features and loading materials/lights/display lists
 */
 void STLViewer::initializeGL() {
-    // Enable stuff
-    qglClearColor(Qt::white);
-  
-    glShadeModel(GL_SMOOTH);
-    
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    
-    glEnable(GL_DEPTH_TEST);
-    
-    glEnable(GL_LINE_SMOOTH);
-    
-    glEnable(GL_BLEND);
-    
-    //   glBlendFunc(GL_ONE, GL_ZERO);
-  
-    // Load materials/lights/textures
-    initMaterials();
-    initLights();
+    scene.initGL();
+    glTimer.init();
 
     // Generate display lists
     initLists();
@@ -303,105 +533,198 @@ void STLViewer::initializeGL() {
   Called automatically when the window is rezied
 */
 void STLViewer::resizeGL(int width, int height) {
-    glViewport(0,0, (GLsizei) width, (GLsizei)height);
-  
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluPerspective(80, 1.0, 1.0, 1000);
-    
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    scene.setProjection(width, height);
 }
 
 /*!
-  Determines the unique name of the thing at pos
+  Casts a ray from the eye through pos and finds the nearest triangle it hits.
+  Replaces GL_SELECT picking, which redrew everything and could only name the whole mesh.
 */
-int STLViewer::nameAtPos(const QPoint &pos) {
+bool STLViewer::pickTriangle(const QPoint &pos, BVHHit &hit) {
+    if (!stlf || stlf->getNumTris() == 0 || !streamSegments.empty()) {
+        return false;
+    }
+    if (!bvh) {
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        bvh = new TriangleBVH(stlf->getPositions(), stlf->getNumTris());
+        QApplication::restoreOverrideCursor();
+    }
 
-    const int MaxSize = 2048;
-    GLuint buffer[MaxSize];
+    makeCurrent();
     GLint viewport[4];
-
-    // Picking requires drawing the scene in GL_SELECT mode,
-    // which requires a little setup
-  
-    // For details on how this work, see the "OpenGL Programming Guide"
-    // All editions should give the details, but the fifth edition,
-    // pages 570-580 is where I got it.
-
-    // The general idea is to draw a tiny portion of the screen around
-    // the mouse position in GL_SELECT mode, then switch back to GL_RENDER
-    // mode, which will return the number of hits and populate "buffer".
-    // Then search for the closest hit.
-
+    GLdouble proj[16];
+    GLdouble model[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
     glGetIntegerv(GL_VIEWPORT, viewport);
 
-    glSelectBuffer(MaxSize, buffer);
-  
-    glRenderMode(GL_SELECT);
-  
-    glInitNames();
-    glPushName(0);
-
-    // setup the viewing transformation
-    glPushMatrix();
+    // The same view transformation paintGL puts on the projection matrix
+    float center[3];
+    calculateCenter(center);
     glMatrixMode(GL_PROJECTION);
     glPushMatrix();
-    glLoadIdentity();
+    scene.applyCamera(translate, rotationX, rotationY, rotationZ, center);
+    glGetDoublev(GL_PROJECTION_MATRIX, proj);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
 
-    // Make it use a 2.0x2.0 area round the mouse click
-    gluPickMatrix(GLdouble(pos.x()), GLdouble(viewport[3]-pos.y()),
-                  2.0,2.0, viewport);
-    // The regular view transformation
-    gluPerspective(80, 1.0, 1.0, 180);
+    GLdouble winX = pos.x();
+    GLdouble winY = viewport[3] - pos.y();
+    GLdouble nearPt[3], farPt[3];
+    if (!gluUnProject(winX, winY, 0.0, model, proj, viewport, &nearPt[0], &nearPt[1], &nearPt[2]) ||
+        !gluUnProject(winX, winY, 1.0, model, proj, viewport, &farPt[0], &farPt[1], &farPt[2])) {
+        return false;
+    }
 
-    // Switch to GL_MODELVIEW and draw the scene
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-  
-    paintGL();
+    // Points along the ray are linear in eye depth, so step back from the near plane to the eye
+    double back = NEAR_PLANE/(FAR_PLANE - NEAR_PLANE);
+    float origin[3], dir[3];
+    for (size_t k=0; k<3; ++k) {
+        dir[k] = float(farPt[k] - nearPt[k]);
+        origin[k] = float(nearPt[k] - back*(farPt[k] - nearPt[k]));
+    }
+    return bvh->intersect(origin, dir, hit);
+}
 
-    // Reset the view and model transforms
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-  
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
+/*!
+  Moves a copy of the flagged facets into buffer, or leaves it in tris if
+  buffer objects can't be used
+*/
+static void uploadFlagged(QGLBuffer &buffer, std::vector<float> &tris, bool allowBuffers) {
+    qint64 bytes = qint64(tris.size()*sizeof(float));
+    if (tris.empty() || !allowBuffers || bytes > INT_MAX || !buffer.create()) {
+        return;
+    }
+    buffer.setUsagePattern(QGLBuffer::StaticDraw);
+    buffer.bind();
+    buffer.allocate(&tris[0], int(bytes));
+    buffer.release();
+    std::vector<float>().swap(tris);
+}
 
-    // Switch back to GL_RENDER and get the number of hits
-    int numHits = glRenderMode(GL_RENDER);
+/*!
+  Runs the normal check on the model and collects the facets to highlight
+*/
+void STLViewer::updateNormalCheck() {
+    flippedBuffer.destroy();
+    degenerateBuffer.destroy();
+    std::vector<float>().swap(flippedTris);
+    std::vector<float>().swap(degenerateTris);
+    numFlipped = numDegenerate = 0;
+    if (!highlightNormals || !stlf || stlf->getNumTris() == 0) {
+        return;
+    }
 
-    // Return -1 if no hits
-    if (numHits <=0)
-        return -1;
+    ProfileScope profile("checkNormals");
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<unsigned char> flags;
+    NormalCheckCounts counts = stlf->checkNormals(flags);
+    qint64 checkTime = timer.elapsed();
+
+    flippedTris.reserve(9*counts.flipped);
+    degenerateTris.reserve(9*counts.degenerate);
+    const float *vp = stlf->getPositions();
+    for (size_t i=0; i<flags.size(); ++i) {
+        if (flags[i] == NORMAL_FLIPPED) {
+            flippedTris.insert(flippedTris.end(), vp + 9*i, vp + 9*i + 9);
+        } else if (flags[i] == NORMAL_DEGENERATE) {
+            degenerateTris.insert(degenerateTris.end(), vp + 9*i, vp + 9*i + 9);
+        }
+    }
+    numFlipped = counts.flipped;
+    numDegenerate = counts.degenerate;
+    makeCurrent();
+    uploadFlagged(flippedBuffer, flippedTris, allowBuffers);
+    uploadFlagged(degenerateBuffer, degenerateTris, allowBuffers);
+
+    emit statusMessage(tr("%1 flipped, %2 degenerate and %3 unset normals in %4 facets, checked in %5 ms")
+                       .arg(counts.flipped).arg(counts.degenerate).arg(counts.unset)
+                       .arg(stlf->getNumTris()).arg(checkTime));
+}
 
-    int closest = 0;
+/*!
+  Fills flipped facets in magenta and marks degenerate ones in orange.
+  They're drawn without the polygon offset so they sit on top of the surface.
+*/
+void STLViewer::drawBadNormals() {
+    if (numFlipped == 0 && numDegenerate == 0) {
+        return;
+    }
+    GLProfileScope profile(glTimer, "drawBadNormals");
+    glDisable(GL_LIGHTING);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glEnableClientState(GL_VERTEX_ARRAY);
+
+    if (numFlipped) {
+        if (flippedBuffer.isCreated()) {
+            flippedBuffer.bind();
+            glVertexPointer(3, GL_FLOAT, 0, 0);
+            flippedBuffer.release();
+        } else {
+            glVertexPointer(3, GL_FLOAT, 0, &flippedTris[0]);
+        }
+        glColor3f(1.0f, 0.0f, 1.0f);
+        glDrawArrays(GL_TRIANGLES, 0, GLsizei(3*numFlipped));
+    }
 
-    // Loop through the returned hits to determine the closest one
-    for (int i=0;i<numHits;++i) {
-        if (buffer[4*i+1]<buffer[4*closest+1] ||
-            buffer[4*i+2]<buffer[4*closest+2]) {
-            closest = i;
+    if (numDegenerate) {
+        if (degenerateBuffer.isCreated()) {
+            degenerateBuffer.bind();
+            glVertexPointer(3, GL_FLOAT, 0, 0);
+            degenerateBuffer.release();
+        } else {
+            glVertexPointer(3, GL_FLOAT, 0, &degenerateTris[0]);
         }
+        // They have no area to fill, so show their edges and corners
+        glColor3f(1.0f, 0.5f, 0.0f);
+        glLineWidth(2.0);
+        glPointSize(5.0);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        glDrawArrays(GL_TRIANGLES, 0, GLsizei(3*numDegenerate));
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glDrawArrays(GL_POINTS, 0, GLsizei(3*numDegenerate));
     }
 
-    // Return the closest hit
-    return buffer[4*closest + 3];
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glEnable(GL_LIGHTING);
+}
+
+/*!
+  Outlines the picked triangle
+*/
+void STLViewer::drawPicked() {
+    if (pickedTri < 0 || size_t(pickedTri) >= num_tris) {
+        return;
+    }
+    const float *tri = stlf->getPositions() + 9*size_t(pickedTri);
+    glDisable(GL_LIGHTING);
+    glColor3f(1.0f, 0.0f, 0.0f);
+    glLineWidth(3.0);
+    glBegin(GL_LINE_LOOP);
+    glVertex3fv(tri);
+    glVertex3fv(tri+3);
+    glVertex3fv(tri+6);
+    glEnd();
+    glEnable(GL_LIGHTING);
 }
 
 /*!
   Called by the system to draw the display
 */
 void STLViewer::paintGL() {
+    glTimer.collect();
+    ProfileScope profile("paintGL");
+    QElapsedTimer renderTimer;
+    renderTimer.start();
+
+    float center[3];
+    calculateCenter(center);
 
     // Rotate/translate the projection matrix
     glMatrixMode(GL_PROJECTION);
     glPushMatrix();
     
-    glTranslatef(0.0,0.0,-translate);
-    glRotatef(rotationX, 1.0, 0.0, 0.0);
-    glRotatef(rotationY, 0.0, 1.0, 0.0);
-    glRotatef(rotationZ, 0.0, 0.0, 1.0);
+    scene.applyCamera(translate, rotationX, rotationY, rotationZ, center);
 
     // Switch to modelview mode and draw the scene
     glMatrixMode(GL_MODELVIEW);
@@ -412,58 +735,59 @@ void STLViewer::paintGL() {
 
     
     if (stlf) {
-        float minz = calculateMinimumZoom();
-        light_position[0][0]=2.0*minz;
-        light_position[0][1]=2.0*minz;
-        light_position[0][2]=2.0*minz;
-        
-        light_position[1][0]=2.0*minz;
-        light_position[1][1]=2.0*minz;
-        light_position[1][2]=-2.0*minz;
+        scene.placeLights(calculateMinimumZoom(), center);
     }
-    light_position[0][3]=1.0f;
-    light_position[1][3]=1.0f;
 
     // Setup the lights
-    glLightfv(GL_LIGHT0, GL_POSITION, light_position[0]);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_color[0]);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, light_color[0]);
-  
-    glLightfv(GL_LIGHT1, GL_POSITION, light_position[1]);
-    glLightfv(GL_LIGHT1, GL_DIFFUSE, light_color[1]);
-    glLightfv(GL_LIGHT1, GL_SPECULAR, light_color[1]);
-  
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, lmodel_ambient[0]);
+    scene.applyLights();
     glLoadIdentity();
 
-    if (stlf) {
-        glLoadName(1);
-        // TODO: See about reusing the display list by changing the polygon fill mode.
-        if (showPolygons) {
-            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat_diffuse[SURF_MAT]);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, mat_specular[SURF_MAT]);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, mat_shininess[SURF_MAT]);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, mat_ambient[SURF_MAT]);
+    drawnRung = 0;
 
-            glCallList(dispLists[0]);
+    if (!streamSegments.empty()) {
+        scene.useMaterial(SURF_MAT);
+
+        drawStream();
+    } else if (stlf) {
+        cullClusters();
+        // While the view moves, the scheduler may pick a simplified level
+        // or leave out the facet outlines to keep up
+        drawnRung = interacting() ? std::min(detailRung, numDetailRungs()-1) : 0;
+        bool coarse = drawnRung > 0 && !lodLevels.empty();
+        size_t level = coarse ? std::min(drawnRung-1, lodLevels.size()-1) : 0;
+        if (showPolygons) {
+            GLProfileScope profileSurface(glTimer, "draw surface");
+            scene.useMaterial(SURF_MAT);
+
+            if (coarse) {
+                drawLOD(level);
+            } else {
+                drawMesh();
+            }
         }
         
-        if (showFacets) {
-            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat_diffuse[LINE_MAT]);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, mat_specular[LINE_MAT]);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, mat_shininess[LINE_MAT]);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, mat_ambient[LINE_MAT]);
-
-            glCallList(dispLists[1]);
+        if (showFacets && drawnRung <= lodLevels.size()) {
+            GLProfileScope profileFacets(glTimer, "draw facet outlines");
+            scene.useMaterial(LINE_MAT);
+
+            glLineWidth(1.5);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            if (coarse) {
+                drawLOD(level);
+            } else {
+                drawMesh();
+            }
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
         }
-        if (showNorms) {
-            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat_diffuse[LINE_MAT]);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, mat_specular[LINE_MAT]);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, mat_shininess[LINE_MAT]);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, mat_ambient[LINE_MAT]);
+        if (showNorms && drawnRung == 0) {
+            scene.useMaterial(LINE_MAT);
 
-            glCallList(dispLists[2]);
+            drawNormals();
+        }
+        if (highlightNormals) {
+            drawBadNormals();
         }
+        drawPicked();
     }
 
     // Reset to how we found things
@@ -472,7 +796,45 @@ void STLViewer::paintGL() {
     glPopMatrix();
     
     glMatrixMode(GL_MODELVIEW);
-    glFlush();
+    if (Profiler::isEnabled()) {
+        drawProfile();
+    }
+    if (inputPending) {
+        // The cost of this frame for adaptDetail, without any wait for the retrace
+        glFinish();
+        renderMs = renderTimer.nsecsElapsed()*1.0e-6;
+    } else {
+        glFlush();
+    }
+}
+
+/*!
+  Lists the profile in the top left corner.  Times are from earlier frames,
+  since the GPU ones take a frame or two to arrive.
+*/
+void STLViewer::drawProfile() {
+    QStringList lines = Profiler::summary();
+    if (!glTimer.isSupported()) {
+        lines << tr("No GPU timer queries, CPU times only");
+    }
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glColor3f(0.0f, 0.0f, 0.0f);
+    QFont font("Monospace", 9);
+    font.setStyleHint(QFont::TypeWriter);
+    int lineHeight = QFontMetrics(font).height();
+    for (int i=0; i<lines.size(); ++i) {
+        renderText(8, 8 + (i+1)*lineHeight, lines.at(i), font);
+    }
+    glPopAttrib();
+}
+
+/*!
+  Starts or stops recording, which also shows or hides the overlay
+*/
+void STLViewer::setProfiling(bool profile) {
+    Profiler::setEnabled(profile);
+    updateGL();
 }
 
 /*!
@@ -485,12 +847,9 @@ void STLViewer::mousePressEvent(QMouseEvent *event) {
 
     clicked = true;
 
-    // Used for picking, which isn't used
-    // Try to get the name at this position
-    // int temp = nameAtPos(event->pos());
-  
     // Set the last postion for rotations
     lastPos = event->pos();
+    pressPos = event->pos();
   
   
     // Update the display
@@ -506,28 +865,86 @@ void STLViewer::mouseMoveEvent(QMouseEvent *event) {
     GLfloat dx = GLfloat(event->x() - lastPos.x())/width();
     GLfloat dy = GLfloat(event->y() - lastPos.y())/height();
 
-    // Rotate depending on which mouse button is clicked
+    // Rotate depending on which mouse button is clicked.  Moves between
+    // frames add up here and are drawn together.
     if (event->buttons() & Qt::LeftButton) {
+        beginInteraction();
         rotationX += 180*dy;
         rotationY += 180*dx;
-        updateGL();
+        dragging = true;
+        requestFrame();
     } else if (event->buttons() & Qt::RightButton) {
+        beginInteraction();
         rotationX += 180*dy;
         rotationZ += 180*dx;
-        updateGL();
+        dragging = true;
+        requestFrame();
     }
   
     // Save the current position
     lastPos = event->pos();
 }
 
+/*!
+  A left click that didn't turn into a drag picks the triangle under the mouse
+*/
+void STLViewer::mouseReleaseEvent(QMouseEvent *event) {
+    if (dragging) {
+        dragging = false;
+        finishInteraction();
+    }
+    if (event->button() != Qt::LeftButton ||
+        (event->pos() - pressPos).manhattanLength() > QApplication::startDragDistance()) {
+        return;
+    }
+    bool firstPick = (bvh == 0);
+    QElapsedTimer timer;
+    timer.start();
+    BVHHit hit;
+    if (pickTriangle(event->pos(), hit)) {
+        double usecs = timer.nsecsElapsed()/1000.0;
+        pickedTri = long(hit.triangle);
+        QString msg = tr("Triangle %1 at (%2, %3, %4), distance %5")
+            .arg(hit.triangle).arg(hit.point[0]).arg(hit.point[1]).arg(hit.point[2]).arg(hit.distance);
+        if (firstPick) {
+            msg += tr(", picking set up in %1 ms").arg(timer.elapsed());
+        } else {
+            msg += tr(", picked in %1 us").arg(usecs, 0, 'f', 1);
+        }
+        emit statusMessage(msg);
+    } else {
+        pickedTri = -1;
+        emit statusMessage(QString());
+    }
+    updateGL();
+}
+
 float STLViewer::calculateMinimumZoom() {
     double minz = 0.125;
-    if (stlf) {
-        minz = 1.25f*stlf->getBoundingRadius();
+    if (!streamSegments.empty()) {
+        // The sphere around the streamed box
+        float diag2 = 0.0f;
+        for (size_t k=0; k<3; ++k) {
+            diag2 += (streamMax[k] - streamMin[k])*(streamMax[k] - streamMin[k]);
+        }
+        minz = SceneSetup::minimumZoom(0.5f*std::sqrt(diag2));
+    } else if (stlf) {
+        minz = SceneSetup::minimumZoom(stlf->getBoundingRadius());
     }
     return minz;
 }
+
+void STLViewer::calculateCenter(float center[3]) {
+    if (!streamSegments.empty()) {
+        for (size_t k=0; k<3; ++k) {
+            center[k] = 0.5f*(streamMin[k] + streamMax[k]);
+        }
+    } else if (stlf) {
+        stlf->getCenter(center);
+    } else {
+        std::fill(center, center+3, 0.0f);
+    }
+}
 /*!
   Handle zooming
 */
@@ -535,12 +952,134 @@ void STLViewer::wheelEvent(QWheelEvent *event) {
 
     double minz = calculateMinimumZoom();
     double dz= -0.125*0.25*0.25 * minz;
+    beginInteraction();
     translate += event->delta()*dz;
 
     if (translate<minz) {
         translate = minz;
     }
-    updateGL();
+    // The zoom is over once the wheel has been still for a moment
+    zoomTimer->start();
+    requestFrame();
+}
+
+bool STLViewer::interacting() const {
+    return dragging || zoomTimer->isActive();
+}
+
+/*!
+  Starts the latency totals and picks the first detail rung when a drag
+  or zoom starts.  Big views start on the finest simplified level.
+*/
+void STLViewer::beginInteraction() {
+    if (interacting()) {
+        return;
+    }
+    interactionFrames = 0;
+    interactionEvents = 0;
+    latencyTotal = 0.0;
+    latencyWorst = 0.0;
+    rungCost.assign(numDetailRungs(), 0.0);
+    detailRung = (!lodLevels.empty() && visibleTris > LOD_DRAG_TRIS) ? 1 : 0;
+}
+
+/*!
+  Marks the view as changed and schedules a frame for one refresh interval
+  after the last, or straight away if that's already passed
+*/
+void STLViewer::requestFrame() {
+    if (!inputPending) {
+        inputPending = true;
+        sinceInput.start();
+        pendingEvents = 0;
+    }
+    ++pendingEvents;
+    if (!frameTimer->isActive()) {
+        qint64 wait = sinceFrame.isValid() ? frameInterval - sinceFrame.elapsed() : 0;
+        frameTimer->start(int(std::max(qint64(0), wait)));
+    }
+}
+
+/*!
+  Draws the input gathered since the last frame, unless something else
+  already has
+*/
+void STLViewer::frameDue() {
+    if (inputPending) {
+        updateGL();
+    }
+}
+
+/*!
+  Ends a drag or zoom: redraws at full detail if it was cut back and
+  reports the latency
+*/
+void STLViewer::finishInteraction() {
+    if (interacting()) {
+        return;
+    }
+    if (drawnRung > 0) {
+        update();
+    }
+    if (interactionFrames > 0) {
+        emit statusMessage(tr("%1 frames for %2 mouse events, input to screen %3 ms on average, %4 ms at worst")
+                           .arg(interactionFrames).arg(interactionEvents)
+                           .arg(latencyTotal/interactionFrames, 0, 'f', 1)
+                           .arg(latencyWorst, 0, 'f', 1));
+        interactionFrames = 0;
+    }
+}
+
+size_t STLViewer::numDetailRungs() const {
+    return lodLevels.size() + 2;
+}
+
+/*!
+  Moves one rung coarser after a frame over the interval, or one finer if
+  this frame took under half of it and the finer rung fit last time
+*/
+void STLViewer::adaptDetail(double frameMs) {
+    if (rungCost.size() != numDetailRungs()) {
+        // Simplified levels came or went mid interaction
+        rungCost.assign(numDetailRungs(), 0.0);
+    }
+    if (drawnRung >= rungCost.size()) {
+        return;
+    }
+    rungCost[drawnRung] = frameMs;
+    if (frameMs > frameInterval && drawnRung+1 < numDetailRungs()) {
+        detailRung = drawnRung + 1;
+    } else if (drawnRung > 0 && frameMs < 0.5*frameInterval &&
+               rungCost[drawnRung-1] < frameInterval) {
+        detailRung = drawnRung - 1;
+    }
+}
+
+/*!
+  Paints and swaps like QGLWidget, then for frames that show new input
+  waits for the swap so the input to screen latency can be measured.
+  Waiting also stops frames queueing up behind the input.
+*/
+void STLViewer::glDraw() {
+    QGLWidget::glDraw();
+    if (inputPending) {
+        makeCurrent();
+        glFinish();
+        qint64 latency = sinceInput.nsecsElapsed();
+        double latencyMs = latency*1.0e-6;
+        inputPending = false;
+        ++interactionFrames;
+        interactionEvents += pendingEvents;
+        latencyTotal += latencyMs;
+        latencyWorst = std::max(latencyWorst, latencyMs);
+        if (Profiler::isEnabled()) {
+            Profiler::record("input to screen", Profiler::now() - latency, latency, false);
+        }
+        if (interacting()) {
+            adaptDetail(renderMs);
+        }
+    }
+    sinceFrame.start();
 }
 
 /*!
@@ -548,8 +1087,8 @@ void STLViewer::wheelEvent(QWheelEvent *event) {
 */
 void STLViewer::resetView() {
     translate = calculateMinimumZoom();
-    rotationX = 27.2457f;
-    rotationY = -46.44f;
+    rotationX = DEFAULT_ROTATION_X;
+    rotationY = DEFAULT_ROTATION_Y;
     rotationZ = 0.0f;
     updateGL();
 }
@@ -571,30 +1110,346 @@ inline void STLViewer::handleGLError(size_t ln) {
     throw new std::runtime_error(err.str());
 }
 
-bool STLViewer::openFile(QString fileName) {
-    STLFile *newf;
+/*!
+  Starts loading fileName on a worker thread.
+  The current model stays up until the new one is ready.
+*/
+void STLViewer::openFile(QString fileName) {
+    if (loader) {
+        loader->disconnect(this);
+        delete loader;
+        loader = 0;
+    }
+    clearStream();
+    loader = new STLLoader(fileName, this);
+    // Streaming needs buffer objects to append to
+    loader->setStreaming(progressiveLoad && allowBuffers);
+    loader->setCacheDir(cacheDir);
+    connect(loader, SIGNAL(loadProgress(qint64, qint64, qint64)),
+            this, SIGNAL(loadProgress(qint64, qint64, qint64)));
+    connect(loader, SIGNAL(finished()), this, SLOT(loaderFinished()));
+    emit loadStarted(fileName);
+    loader->start();
+    streamTimer->start();
+}
+
+/*!
+  Stops the load in progress, if any, and keeps the current model
+*/
+void STLViewer::cancelLoad() {
+    if (loader) {
+        loader->cancel();
+    }
+}
+
+/*!
+  Writes the current model, including any repairs, to fileName
+*/
+void STLViewer::saveFile(QString fileName, bool binary) {
+    if (!stlf) {
+        return;
+    }
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QElapsedTimer timer;
+    timer.start();
     try {
-        newf = new STLFile(fileName.toStdString());
-    } catch (std::runtime_error re) {
-        newf = 0;
-        QMessageBox::critical(this, tr("STL Viewer"),
-                              QString(re.what()));
-        return false;
+        stlf->save(QFile::encodeName(fileName).constData(), binary);
+        QApplication::restoreOverrideCursor();
+        emit statusMessage(tr("Saved %1 facets to %2 in %3 ms")
+                           .arg(stlf->getNumTris()).arg(fileName).arg(timer.elapsed()));
+    } catch (std::runtime_error &re) {
+        QApplication::restoreOverrideCursor();
+        QMessageBox::critical(this, tr("STL Viewer"), QString(re.what()));
     }
-    
+}
+
+/*!
+  Fixes the winding and normals of the current model and uploads it again
+*/
+void STLViewer::repairNormals() {
+    if (!stlf || stlf->getNumTris() == 0 || loader) {
+        return;
+    }
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    // The simplifier reads the positions on its own thread
+    clearLOD();
+    QElapsedTimer timer;
+    timer.start();
+    NormalRepairCounts counts = stlf->repairNormals();
+    qint64 repairTime = timer.elapsed();
+
+    makeCurrent();
+    regenList();
+    updateNormalCheck();
+    startLOD();
+    QApplication::restoreOverrideCursor();
+
+    emit statusMessage(tr("Reversed %1 and renormalized %2 of %3 facets in %4 ms. "
+                          "%5 shells, %6 open, %7 edges couldn't be wound consistently")
+                       .arg(counts.rewound).arg(counts.renormalized).arg(stlf->getNumTris())
+                       .arg(repairTime).arg(counts.shells).arg(counts.open_shells)
+                       .arg(counts.conflicts));
+    updateGL();
+}
+
+/*!
+  Swaps in the newly loaded model and uploads it to the GPU
+*/
+void STLViewer::loaderFinished() {
+    ProfileScope profile("loaderFinished");
+    STLLoader *done = loader;
+    loader = 0;
+    streamTimer->stop();
+    makeCurrent();
+    clearStream();
+    if (!done) {
+        updateGL();
+        return;
+    }
+    STLFile *newf = done->takeFile();
     if (newf) {
+        // The hierarchy and the simplifier both read the old model's positions
+        clearLOD();
+        delete bvh;
+        bvh = 0;
+        pickedTri = -1;
         if (stlf) {
             delete stlf;
         }
         stlf = newf;
         regenList();
+        updateNormalCheck();
+        resetView();
+        startLOD();
+    } else {
+        // Back to the old model
+        updateGL();
+        if (!done->wasCancelled()) {
+            QMessageBox::critical(this, tr("STL Viewer"), done->errorString());
+        }
+    }
+    emit loadFinished(done->fileName(), newf != 0);
+    done->deleteLater();
+}
+
+/*!
+  Uploads whatever the loader has decoded since the last poll and redraws.
+  Runs off a timer, so repaints are throttled no matter how fast batches arrive.
+*/
+void STLViewer::pollStream() {
+    if (!loader) {
+        return;
+    }
+    std::vector<float> vp;
+    std::vector<float> np;
+    loader->takeBatches(vp, np);
+    if (vp.empty()) {
+        return;
+    }
+
+    float oldZoom = calculateMinimumZoom();
+    for (size_t i=0; i<vp.size(); i+=3) {
+        for (size_t k=0; k<3; ++k) {
+            streamMin[k] = std::min(streamMin[k], vp[i+k]);
+            streamMax[k] = std::max(streamMax[k], vp[i+k]);
+        }
+    }
+
+    makeCurrent();
+    bool first = streamSegments.empty();
+    appendStream(&vp[0], &np[0], vp.size()/9);
+    if (streamSegments.empty()) {
+        return;
+    }
+    if (first) {
         resetView();
-        return true;
+    } else if (calculateMinimumZoom() > oldZoom) {
+        // Keep the whole part in view as it grows
+        translate = calculateMinimumZoom();
+        updateGL();
     } else {
-        ;
+        updateGL();
+    }
+}
+
+/*!
+  Appends count triangles to the streaming buffers, starting new segments as needed.
+  Each new segment holds as many triangles as all the earlier ones together,
+  so a small file never reserves a full STREAM_SEGMENT_TRIS buffer.
+*/
+void STLViewer::appendStream(const float *vp, const float *np, size_t count) {
+    GLProfileScope profile(glTimer, "appendStream");
+    const int triBytes = 9*sizeof(float);
+    while (count > 0) {
+        if (streamSegments.empty() || streamSegments.back()->numTris == streamSegments.back()->capacity) {
+            size_t streamed = 0;
+            for (size_t i=0; i<streamSegments.size(); ++i) {
+                streamed += streamSegments[i]->numTris;
+            }
+            StreamSegment *seg = new StreamSegment;
+            seg->numTris = 0;
+            seg->capacity = std::min(STREAM_SEGMENT_TRIS,
+                                     std::max(STREAM_MIN_SEGMENT_TRIS, std::max(count, streamed)));
+            if (!seg->positions.create() || !seg->normals.create()) {
+                // No buffer objects, so just wait for the load to finish
+                delete seg;
+                clearStream();
+                if (loader) {
+                    loader->setStreaming(false);
+                }
+                return;
+            }
+            seg->positions.setUsagePattern(QGLBuffer::StaticDraw);
+            seg->positions.bind();
+            seg->positions.allocate(int(seg->capacity)*triBytes);
+            seg->normals.setUsagePattern(QGLBuffer::StaticDraw);
+            seg->normals.bind();
+            seg->normals.allocate(int(seg->capacity)*triBytes);
+            QGLBuffer::release(QGLBuffer::VertexBuffer);
+            streamSegments.push_back(seg);
+        }
+        StreamSegment *seg = streamSegments.back();
+        size_t n = std::min(count, seg->capacity - seg->numTris);
+        seg->positions.bind();
+        seg->positions.write(int(seg->numTris)*triBytes, vp, int(n)*triBytes);
+        seg->normals.bind();
+        seg->normals.write(int(seg->numTris)*triBytes, np, int(n)*triBytes);
+        QGLBuffer::release(QGLBuffer::VertexBuffer);
+
+        seg->numTris += n;
+        vp += 9*n;
+        np += 9*n;
+        count -= n;
+    }
+}
+
+void STLViewer::clearStream() {
+    if (!streamSegments.empty()) {
+        makeCurrent();
+    }
+    for (size_t i=0; i<streamSegments.size(); ++i) {
+        delete streamSegments[i];
+    }
+    streamSegments.clear();
+    std::fill(streamMin, streamMin+3, FLT_MAX);
+    std::fill(streamMax, streamMax+3, -FLT_MAX);
+}
+
+/*!
+  Draws the triangles streamed in so far, one call per segment
+*/
+void STLViewer::drawStream() {
+    GLProfileScope profile(glTimer, "drawStream");
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    for (size_t i=0; i<streamSegments.size(); ++i) {
+        StreamSegment *seg = streamSegments[i];
+        seg->positions.bind();
+        glVertexPointer(3, GL_FLOAT, 0, 0);
+        seg->normals.bind();
+        glNormalPointer(GL_FLOAT, 0, 0);
+        glDrawArrays(GL_TRIANGLES, 0, 3*seg->numTris);
+    }
+    QGLBuffer::release(QGLBuffer::VertexBuffer);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+/*!
+  Starts simplifying the model in the background if it's big enough to need it
+*/
+void STLViewer::startLOD() {
+    clearLOD();
+    if (!allowBuffers || !stlf || stlf->getNumTris() <= LOD_DRAG_TRIS) {
+        return;
+    }
+    lodBuilder = new LODBuilder(stlf, LOD_DRAG_TRIS, LOD_MIN_TRIS, this);
+    connect(lodBuilder, SIGNAL(finished()), this, SLOT(lodFinished()));
+    lodBuilder->start(QThread::LowPriority);
+}
+
+/*!
+  Stops any simplification in progress and frees the levels
+*/
+void STLViewer::clearLOD() {
+    if (lodBuilder) {
+        lodBuilder->disconnect(this);
+        delete lodBuilder;
+        lodBuilder = 0;
+    }
+    if (!lodLevels.empty()) {
+        makeCurrent();
     }
-    return false;
+    for (size_t i=0; i<lodLevels.size(); ++i) {
+        delete lodLevels[i];
+    }
+    lodLevels.clear();
+}
+
+/*!
+  Uploads the simplified levels and reports how long each took and how far it strays
+*/
+void STLViewer::lodFinished() {
+    // A finished signal from a builder that's since been replaced can still be queued
+    LODBuilder *done = lodBuilder;
+    if (!done || !done->isFinished()) {
+        return;
+    }
+    lodBuilder = 0;
+    std::vector<LODLevel*> levels;
+    done->takeLevels(levels);
+
+    makeCurrent();
+    QStringList report;
+    for (size_t i=0; i<levels.size(); ++i) {
+        LODLevel *level = levels[i];
+        report << tr("%1 triangles in %2 s, error at most %3%")
+            .arg(level->numTris).arg(level->seconds, 0, 'f', 2)
+            .arg(100.0*level->error/stlf->getBoundingRadius(), 0, 'g', 3);
+
+        if (!level->positions.empty()) {
+            int bytes = int(level->positions.size()*sizeof(float));
+            LODBuffer *lod = new LODBuffer;
+            lod->numTris = level->numTris;
+            if (lod->positions.create() && lod->normals.create()) {
+                lod->positions.setUsagePattern(QGLBuffer::StaticDraw);
+                lod->positions.bind();
+                lod->positions.allocate(&level->positions[0], bytes);
+                lod->normals.setUsagePattern(QGLBuffer::StaticDraw);
+                lod->normals.bind();
+                lod->normals.allocate(&level->normals[0], bytes);
+                QGLBuffer::release(QGLBuffer::VertexBuffer);
+                lodLevels.push_back(lod);
+            } else {
+                delete lod;
+            }
+        }
+        delete level;
+    }
+    if (!done->wasCancelled() && !report.isEmpty()) {
+        emit statusMessage(tr("Detail levels after %1 s welding: %2")
+                           .arg(done->weldSeconds(), 0, 'f', 2).arg(report.join("; ")));
+    }
+    done->deleteLater();
 }
+
+/*!
+  Draws a simplified level with its own face normals
+*/
+void STLViewer::drawLOD(size_t level) {
+    LODBuffer *lod = lodLevels[level];
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    lod->positions.bind();
+    glVertexPointer(3, GL_FLOAT, 0, 0);
+    lod->normals.bind();
+    glNormalPointer(GL_FLOAT, 0, 0);
+    glDrawArrays(GL_TRIANGLES, 0, GLsizei(3*lod->numTris));
+    QGLBuffer::release(QGLBuffer::VertexBuffer);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
 void STLViewer::setShowPolygons(bool show) {
     showPolygons = show;
     updateGL();
@@ -607,3 +1462,27 @@ void STLViewer::setShowNormals(bool show) {
     showNorms = show;
     updateGL();
 }
+void STLViewer::setProgressiveLoad(bool progressive) {
+    progressiveLoad = progressive;
+}
+void STLViewer::setCacheDir(QString dir) {
+    cacheDir = dir;
+}
+void STLViewer::setHighlightNormals(bool highlight) {
+    highlightNormals = highlight;
+    makeCurrent();
+    updateNormalCheck();
+    updateGL();
+}
+void STLViewer::setCompactStorage(bool compact) {
+    compactStorage = compact;
+    makeCurrent();
+    regenList();
+    updateGL();
+}
+void STLViewer::setWeldVertices(bool weld) {
+    weldVertices = weld;
+    makeCurrent();
+    regenList();
+    updateGL();
+}
@@ -19,6 +19,7 @@
 #include <QtGui>
 #include <QtOpenGL>
 #include <QGLWidget>
+#include <QGLBuffer>
 
 #ifdef __APPLE_CC__
 #include <OpenGL/gl.h>
@@ -28,14 +29,39 @@
 #include <GL/glu.h>
 #endif
 
+#include <vector>
+#include <utility>
+
 #include "stlfile.h"
+#include "trianglebvh.h"
+#include "meshclusters.h"
+#include "meshquantize.h"
+#include "scenesetup.h"
+#include "gltimer.h"
+
+class STLLoader;
+class LODBuilder;
 
 // Some constants...
-static const size_t NUM_MATERIALS=2;
-static const size_t NUM_LIGHTS=2;
-static const size_t NUM_LISTS=3;
-static const size_t LINE_MAT=0;
-static const size_t SURF_MAT=1;
+static const size_t NUM_LISTS=1;
+// Bounds on the triangles per buffer object while streaming a file in.
+// Segments grow geometrically between them, so small files stay small.
+static const size_t STREAM_MIN_SEGMENT_TRIS=1<<12;
+static const size_t STREAM_SEGMENT_TRIS=1<<20;
+// Milliseconds between repaints while streaming
+static const int STREAM_REPAINT_INTERVAL=250;
+// Triangles per cluster for view frustum culling
+static const size_t CLUSTER_TRIS=4096;
+// Triangles gathered at a time while uploading in cluster order
+static const size_t UPLOAD_CHUNK_TRIS=1<<18;
+// While dragging, views with more triangles than this draw a simplified level
+static const size_t LOD_DRAG_TRIS=1<<19;
+// The coarsest simplified level
+static const size_t LOD_MIN_TRIS=1<<12;
+// Frames per second to pace interaction to when the screen's rate isn't known
+static const int DEFAULT_REFRESH_RATE=60;
+// Milliseconds after the last wheel step that a zoom counts as finished
+static const int ZOOM_SETTLE_INTERVAL=150;
 
 /*!
   STLViewer is the QT widget that displays an STL file
@@ -49,30 +75,77 @@ public:
     
     void resetView();
 
-    bool openFile(QString fileName);
+    void openFile(QString fileName);
+    void saveFile(QString fileName, bool binary);
 
     void setShowPolygons(bool show);
     void setShowFacets(bool show);
     void setShowNormals(bool show);
+    void setWeldVertices(bool weld);
+    void setCompactStorage(bool compact);
+    void setProgressiveLoad(bool progressive);
+    void setCacheDir(QString dir);
+    void setHighlightNormals(bool highlight);
+    void setProfiling(bool profile);
+
+public slots:
+    void cancelLoad();
+    void repairNormals();
+
+signals:
+    void statusMessage(QString msg);
+    void loadStarted(QString fileName);
+    void loadProgress(qint64 bytesDone, qint64 bytesTotal, qint64 trisDone);
+    void loadFinished(QString fileName, bool loaded);
+
+private slots:
+    void loaderFinished();
+    void pollStream();
+    void lodFinished();
+    void frameDue();
+    void finishInteraction();
 
 protected:
     void initializeGL();
     void resizeGL(int width, int height);
     void paintGL();
+    void glDraw();
   
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
     void wheelEvent(QWheelEvent *event);
 
 private:
-    // Returns the "name" of the object at pos
-    int nameAtPos(const QPoint &pos);
+    // Finds the triangle under pos, building the hierarchy on first use
+    bool pickTriangle(const QPoint &pos, BVHHit &hit);
+    void drawPicked();
+    void updateNormalCheck();
+    void drawBadNormals();
+    void drawProfile();
+
+    // Frame scheduling for mouse interaction
+    bool interacting() const;
+    void beginInteraction();
+    void requestFrame();
+    size_t numDetailRungs() const;
+    void adaptDetail(double frameMs);
 
     // Initialization functions
-    void initMaterials();
-    void initLights();
     void initLists();
     void regenList();
+    size_t corner(size_t tri, size_t k) const;
+    bool uploadBuffers(const float *vp, const float *np);
+    void cullClusters();
+    void drawMesh();
+    void buildNormalLines(const float *vp);
+    void drawNormals();
+    void appendStream(const float *vp, const float *np, size_t count);
+    void clearStream();
+    void drawStream();
+    void startLOD();
+    void clearLOD();
+    void drawLOD(size_t level);
     
     void drawBoxList(size_t mat_idx);
 
@@ -80,16 +153,12 @@ private:
     void handleGLError(size_t ln);
 
     float calculateMinimumZoom();
-    // Arrays to hold material properties
-    GLfloat mat_specular[NUM_MATERIALS][4];
-    GLfloat mat_shininess[NUM_MATERIALS][1];
-    GLfloat mat_diffuse[NUM_MATERIALS][4];
-    GLfloat mat_ambient[NUM_MATERIALS][4];
-
-    // Arrays to hold light properties
-    GLfloat light_position[NUM_LIGHTS][4];
-    GLfloat light_color[NUM_LIGHTS][4];
-    GLfloat lmodel_ambient[NUM_LIGHTS][4];
+    // The point the camera orbits, the middle of the model
+    void calculateCenter(float center[3]);
+    // Lights, materials and camera
+    SceneSetup scene;
+    // GPU times for the profile
+    GLTimerQueries glTimer;
 
     // Array of display lists
     GLuint dispLists[NUM_LISTS];
@@ -99,6 +168,8 @@ private:
 
     // Stores last mouse position for rotation
     QPoint lastPos;
+    // Where the mouse went down, a release close by is a pick
+    QPoint pressPos;
 
     // Rotation angles
     GLfloat rotationX;
@@ -111,11 +182,109 @@ private:
     bool clicked;
     
     size_t num_tris;
-    float *verts;
-    float *norms;
-    unsigned int *indices;
+    // Welded mesh, only used when weldVertices is set
+    std::vector<float> verts;
+    std::vector<float> norms;
+    std::vector<unsigned int> indices;
 
     bool showPolygons;
     bool showFacets;
     bool showNorms;
+    bool weldVertices;
+    bool highlightNormals;
+
+    // Vertex buffer objects for the surface, when the driver supports them.
+    // Setting STLVIEWER_NO_VBO in the environment forces display lists.
+    QGLBuffer vertexBuffer;
+    QGLBuffer normalBuffer;
+    QGLBuffer indexBuffer;
+    QGLBuffer normLineBuffer;
+    bool useBuffers;
+    bool allowBuffers;
+
+    // With compact storage the buffers hold GLshort positions in quantFrame
+    // and GLbyte normals instead of floats
+    bool compactStorage;
+    bool compactBuffers;
+    QuantizeFrame quantFrame;
+
+    // Spatial clusters of the triangles in the buffer objects, and the
+    // (first, count) runs of them inside the view this frame
+    std::vector<MeshCluster> clusters;
+    std::vector<std::pair<size_t, size_t> > visibleRuns;
+    size_t visibleTris;
+
+    // Simplified levels for drawing while the view is dragged, finest first
+    struct LODBuffer {
+        QGLBuffer positions;
+        QGLBuffer normals;
+        size_t numTris;
+    };
+    std::vector<LODBuffer*> lodLevels;
+    LODBuilder *lodBuilder;
+    bool dragging;
+
+    // Mouse input only changes the view and asks for a frame.  frameTimer
+    // then paints at most once per refresh interval, so a fast mouse can't
+    // queue up frames the screen never shows.
+    QTimer *frameTimer;
+    // Runs while a zoom is still going
+    QTimer *zoomTimer;
+    int frameInterval;
+    QElapsedTimer sinceFrame;
+    // Oldest input not on screen yet, and how many events it's gathered
+    bool inputPending;
+    QElapsedTimer sinceInput;
+    size_t pendingEvents;
+    // Totals over the current drag or zoom, reported when it ends
+    size_t interactionFrames;
+    size_t interactionEvents;
+    double latencyTotal;
+    double latencyWorst;
+    // Detail while interacting: rung 0 is the full mesh, rung i the (i-1)th
+    // simplified level, and the last rung the coarsest without facet outlines.
+    // It steps coarser when a frame runs over the interval and finer when
+    // there's room.
+    size_t detailRung;
+    size_t drawnRung;
+    // Milliseconds the last frame with new input took to draw
+    double renderMs;
+    // Milliseconds each rung last took this interaction, 0 if not tried
+    std::vector<double> rungCost;
+
+    // Centroid to tip segments for "Show Normals", only kept when not in a buffer object
+    std::vector<float> normLines;
+
+    // Facets that failed the normal check, kept here only when not in buffer objects
+    QGLBuffer flippedBuffer;
+    QGLBuffer degenerateBuffer;
+    std::vector<float> flippedTris;
+    std::vector<float> degenerateTris;
+    size_t numFlipped;
+    size_t numDegenerate;
+
+    // Ray casting hierarchy over stlf, built on the first pick
+    TriangleBVH *bvh;
+    // Highlighted triangle, -1 for none
+    long pickedTri;
+
+    // Background load in progress, if any
+    STLLoader *loader;
+    // Where parsed files are cached, empty when caching is off
+    QString cacheDir;
+
+    // Triangles shown while a file is still loading, in a chain of buffer
+    // objects so the set can grow without copying what's already uploaded
+    struct StreamSegment {
+        QGLBuffer positions;
+        QGLBuffer normals;
+        size_t numTris;
+        size_t capacity;
+    };
+    std::vector<StreamSegment*> streamSegments;
+    QTimer *streamTimer;
+    bool progressiveLoad;
+    // Box around every streamed vertex, empty while min > max
+    float streamMin[3];
+    float streamMax[3];
 };
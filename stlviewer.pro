@@ -8,7 +8,16 @@ DEPENDPATH += .
 INCLUDEPATH += .
 QT += opengl
 
+# OpenMP is used by the parallel loaders
+linux*|win32-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += -openmp
+}
+
 # Input
-HEADERS += mainwindow.h stlfile.h stlviewer.h
-SOURCES += main.cpp mainwindow.cpp stlfile.cpp stlviewer.cpp
+HEADERS += batch.h batchutil.h fastfloat.h gltimer.h lodbuilder.h mainwindow.h mappedfile.h meshclusters.h meshquantize.h meshsimplify.h profiler.h scenesetup.h softrasterizer.h softviewer.h stlfile.h stlloader.h stlviewer.h thumbnailer.h trianglebvh.h
+SOURCES += batch.cpp batchutil.cpp fastfloat.cpp gltimer.cpp lodbuilder.cpp main.cpp mainwindow.cpp mappedfile.cpp meshclusters.cpp meshquantize.cpp meshsimplify.cpp profiler.cpp scenesetup.cpp softrasterizer.cpp softviewer.cpp stlfile.cpp stlloader.cpp stlviewer.cpp thumbnailer.cpp trianglebvh.cpp
 RESOURCES += stlviewer.qrc
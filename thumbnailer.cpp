@@ -0,0 +1,333 @@
+/*
+  thumbnailer.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QGLPixelBuffer>
+#include <QThread>
+#include <QCoreApplication>
+#include <QAtomicInt>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "thumbnailer.h"
+#include "stlfile.h"
+#include "batchutil.h"
+
+// Triangles per draw call, keeps counts well inside a GLsizei
+static const size_t THUMBNAIL_DRAW_TRIS = 1<<20;
+static const int THUMBNAIL_SAMPLES = 4;
+
+ThumbnailRenderer::ThumbnailRenderer(int size) : pbuffer(0), size(size) {
+    if (!QGLPixelBuffer::hasOpenGLPbuffers()) {
+        return;
+    }
+    QGLFormat format(QGL::DepthBuffer | QGL::SampleBuffers);
+    format.setSamples(THUMBNAIL_SAMPLES);
+    pbuffer = new QGLPixelBuffer(QSize(size, size), format);
+    if (!pbuffer->isValid()) {
+        // Not every driver has multisampled pbuffers
+        delete pbuffer;
+        pbuffer = new QGLPixelBuffer(QSize(size, size), QGLFormat(QGL::DepthBuffer));
+    }
+    if (!pbuffer->isValid()) {
+        delete pbuffer;
+        pbuffer = 0;
+        return;
+    }
+    pbuffer->makeCurrent();
+    scene.initGL();
+    scene.setProjection(size, size);
+    pbuffer->doneCurrent();
+}
+
+ThumbnailRenderer::~ThumbnailRenderer() {
+    delete pbuffer;
+}
+
+bool ThumbnailRenderer::isValid() const {
+    return pbuffer != 0;
+}
+
+/*!
+  Draws the surface the way the viewer shows a freshly opened file
+*/
+QImage ThumbnailRenderer::render(const STLFile &stlf) {
+    if (!pbuffer) {
+        return renderSoftware(stlf);
+    }
+    pbuffer->makeCurrent();
+    float minz = SceneSetup::minimumZoom(stlf.getBoundingRadius());
+    float center[3];
+    stlf.getCenter(center);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    scene.applyCamera(minz, DEFAULT_ROTATION_X, DEFAULT_ROTATION_Y, 0.0f, center);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    scene.placeLights(minz, center);
+    scene.applyLights();
+    scene.useMaterial(SURF_MAT);
+
+    const size_t num_tris = stlf.getNumTris();
+    if (num_tris > 0) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, stlf.getPositions());
+        glNormalPointer(GL_FLOAT, 0, stlf.getNormals());
+        for (size_t first=0; first<num_tris; first+=THUMBNAIL_DRAW_TRIS) {
+            size_t count = std::min(THUMBNAIL_DRAW_TRIS, num_tris - first);
+            glDrawArrays(GL_TRIANGLES, GLint(3*first), GLsizei(3*count));
+        }
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+    }
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    QImage image = pbuffer->toImage();
+    pbuffer->doneCurrent();
+    return image;
+}
+
+/*!
+  The same picture without OpenGL, and without multisampling
+*/
+QImage ThumbnailRenderer::renderSoftware(const STLFile &stlf) {
+    float minz = SceneSetup::minimumZoom(stlf.getBoundingRadius());
+    float center[3];
+    stlf.getCenter(center);
+    scene.placeLights(minz, center);
+    RasterLighting lighting;
+    scene.rasterLighting(SURF_MAT, lighting);
+    float clip[16];
+    SceneSetup::cameraMatrix(minz, DEFAULT_ROTATION_X, DEFAULT_ROTATION_Y, 0.0f, center, clip);
+
+    raster.resize(size, size);
+    raster.clear(0xffffffffu);
+    raster.draw(stlf.getPositions(), stlf.getNormals(), stlf.getNumTris(), clip, lighting);
+    // Copied, because the buffer is reused for the next file
+    return QImage((const uchar*)raster.pixels(), size, size, QImage::Format_RGB32).copy();
+}
+
+/*!
+  One render context in the pool.  Workers take the next file from a shared
+  counter, so slow files don't hold up the others.
+*/
+class ThumbnailWorker : public QThread {
+public:
+    ThumbnailWorker(const QStringList &files, const QStringList &images, int size, bool pooled,
+                    QAtomicInt *next, std::vector<BatchResult> *results)
+        : files(files), images(images), size(size), pooled(pooled), next(next), results(results) {
+    }
+
+protected:
+    void run();
+
+private:
+    BatchResult renderFile(ThumbnailRenderer &renderer, const QString &fname, const QString &image);
+
+    QStringList files;
+    QStringList images;
+    int size;
+    bool pooled;
+    QAtomicInt *next;
+    std::vector<BatchResult> *results;
+};
+
+void ThumbnailWorker::run() {
+#ifdef _OPENMP
+    // Parallelism comes from the pool, so each file is parsed on one thread
+    if (pooled) {
+        omp_set_num_threads(1);
+    }
+#endif
+    ThumbnailRenderer renderer(size);
+    int i;
+    while ((i = next->fetchAndAddOrdered(1)) < files.size()) {
+        (*results)[i] = renderFile(renderer, files.at(i), images.at(i));
+    }
+}
+
+/*!
+  Loads, renders and saves one thumbnail, returning its JSON entry
+*/
+BatchResult ThumbnailWorker::renderFile(ThumbnailRenderer &renderer, const QString &fname,
+                                        const QString &image) {
+    BatchResult result;
+    std::string &json = result.json;
+    json = "    {\"file\": " + jsonString(fname) + ", \"image\": " + jsonString(image);
+    char buf[256];
+    try {
+        QElapsedTimer timer;
+        timer.start();
+        STLFile stlf(QFile::encodeName(fname).constData());
+        double parseSeconds = timer.nsecsElapsed()*1.0e-9;
+
+        timer.restart();
+        QImage thumbnail = renderer.render(stlf);
+        double renderSeconds = timer.nsecsElapsed()*1.0e-9;
+
+        timer.restart();
+        if (!thumbnail.save(image, "PNG")) {
+            throw std::runtime_error("Could not write the image");
+        }
+        double saveSeconds = timer.nsecsElapsed()*1.0e-9;
+
+        std::sprintf(buf, ", \"triangles\": %lu", (unsigned long)stlf.getNumTris());
+        json += buf;
+        json += ", \"parse_seconds\": " + jsonNumber(parseSeconds, "%.6f") +
+            ", \"render_seconds\": " + jsonNumber(renderSeconds, "%.6f") +
+            ", \"save_seconds\": " + jsonNumber(saveSeconds, "%.6f") + "}";
+        result.ok = true;
+    } catch (std::runtime_error &re) {
+        json += ", \"error\": " + jsonString(QString(re.what())) + "}";
+    } catch (std::bad_alloc &) {
+        json += ", \"error\": \"out of memory\"}";
+    }
+    return result;
+}
+
+/*!
+  Picks the PNG for each file, mirroring the layout of the input
+  directories under outDir so same-named models in different folders
+  don't overwrite each other.  Names that still collide, like two files
+  given directly with the same name, get a numbered suffix and a warning.
+  Creates the directories, so the workers only write files.
+*/
+static QStringList thumbnailPaths(const QString &outDir, const QStringList &files,
+                                  const QStringList &relative) {
+    QDir out(outDir);
+    QStringList images;
+    QSet<QString> taken;
+    for (int i=0; i<relative.size(); ++i) {
+        QFileInfo rel(relative[i]);
+        QString base = rel.path() == "." ? rel.completeBaseName()
+            : rel.path() + "/" + rel.completeBaseName();
+        QString image = out.filePath(base + ".png");
+        if (taken.contains(image)) {
+            for (int n=2; taken.contains(image); ++n) {
+                image = out.filePath(base + "-" + QString::number(n) + ".png");
+            }
+            std::fprintf(stderr, "Thumbnail name for %s is already used, writing %s instead\n",
+                         QFile::encodeName(files[i]).constData(), QFile::encodeName(image).constData());
+        }
+        taken.insert(image);
+        out.mkpath(QFileInfo(image).path());
+        images << image;
+    }
+    return images;
+}
+
+/*!
+  True if OpenGL contexts can be used from several threads at once.  On
+  X11 that needs AA_X11InitThreads set before QApplication, which older
+  Qt doesn't have.
+*/
+static bool threadedGL() {
+#if defined(Q_WS_X11) && QT_VERSION >= 0x040800
+    return QCoreApplication::testAttribute(Qt::AA_X11InitThreads);
+#elif defined(Q_WS_X11)
+    return false;
+#else
+    return true;
+#endif
+}
+
+int runThumbnails(int argc, char *argv[]) {
+    QStringList args;
+    QString outDir = ".";
+    int size = 256;
+    int contexts = QThread::idealThreadCount();
+    for (int i=0; i<argc; ++i) {
+        if (0 == std::strcmp(argv[i], "-s") && i+1 < argc) {
+            size = std::atoi(argv[++i]);
+        } else if (0 == std::strcmp(argv[i], "-j") && i+1 < argc) {
+            contexts = std::atoi(argv[++i]);
+        } else if (0 == std::strcmp(argv[i], "-o") && i+1 < argc) {
+            outDir = QFile::decodeName(argv[++i]);
+        } else {
+            args << QFile::decodeName(argv[i]);
+        }
+    }
+    QStringList relative;
+    QStringList files = collectFiles(args, &relative);
+    if (files.isEmpty() || size <= 0) {
+        std::fprintf(stderr, "Usage: stlviewer --thumbnails [-s size] [-j contexts] [-o directory] file-or-directory...\n"
+                     "Without a display, run it under a virtual X server such as xvfb-run.\n");
+        return 1;
+    }
+    if (!QGLPixelBuffer::hasOpenGLPbuffers()) {
+        std::fprintf(stderr, "This system has no OpenGL pbuffer support, using software rendering\n");
+    } else if (contexts > 1 && !threadedGL()) {
+        std::fprintf(stderr, "OpenGL can't be used from several threads here, using one context\n");
+        contexts = 1;
+    }
+    QStringList images = thumbnailPaths(outDir, files, relative);
+    contexts = std::max(1, std::min(contexts, int(files.size())));
+
+    QElapsedTimer timer;
+    timer.start();
+    QAtomicInt next(0);
+    std::vector<BatchResult> results(files.size());
+    std::vector<ThumbnailWorker*> workers;
+    for (int i=0; i<contexts; ++i) {
+        workers.push_back(new ThumbnailWorker(files, images, size, contexts > 1, &next, &results));
+        workers.back()->start();
+    }
+    for (size_t i=0; i<workers.size(); ++i) {
+        workers[i]->wait();
+        delete workers[i];
+    }
+    double totalSeconds = timer.nsecsElapsed()*1.0e-9;
+
+    bool failed = false;
+    size_t rendered = 0;
+    for (size_t i=0; i<results.size(); ++i) {
+        failed = failed || !results[i].ok;
+        rendered += results[i].ok ? 1 : 0;
+    }
+    // QApplication has set the user's locale, so the numbers go through jsonNumber
+    std::printf("{\n  \"contexts\": %d,\n  \"size\": %d,\n  \"total_seconds\": %s,\n"
+                "  \"thumbnails_per_second\": %s,\n  \"files\": [\n",
+                contexts, size, jsonNumber(totalSeconds, "%.6f").c_str(),
+                jsonNumber(totalSeconds > 0.0 ? rendered/totalSeconds : 0.0, "%.3f").c_str());
+    for (size_t i=0; i<results.size(); ++i) {
+        std::printf("%s%s\n", results[i].json.c_str(), (i+1 < results.size()) ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+    return failed ? 2 : 0;
+}
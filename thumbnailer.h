@@ -0,0 +1,63 @@
+/*
+  thumbnailer.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef THUMBNAILER_HEADER
+#define THUMBNAILER_HEADER
+
+#include <QImage>
+
+#include "scenesetup.h"
+
+class QGLPixelBuffer;
+class STLFile;
+
+/*!
+  Draws models into an offscreen pbuffer with the viewer's lights,
+  materials and reset view.  Each renderer has its own OpenGL context, so
+  several can work at once from different threads.  Where no pbuffer can
+  be made it draws with SoftRasterizer instead.
+*/
+class ThumbnailRenderer {
+public:
+    ThumbnailRenderer(int size);
+    ~ThumbnailRenderer();
+
+    // False if no pbuffer could be created, and render draws in software
+    bool isValid() const;
+    QImage render(const STLFile &stlf);
+
+private:
+    // Not copyable
+    ThumbnailRenderer(const ThumbnailRenderer &);
+    ThumbnailRenderer &operator=(const ThumbnailRenderer &);
+
+    QImage renderSoftware(const STLFile &stlf);
+
+    QGLPixelBuffer *pbuffer;
+    SoftRasterizer raster;
+    SceneSetup scene;
+    int size;
+};
+
+// stlviewer --thumbnails [-s size] [-j contexts] [-o directory] file-or-directory...
+// Renders a PNG of each model, laid out under the output directory the way the
+// input directories are, and prints timings as JSON.  Needs a display but no window,
+// and uses OpenGL where it can.
+int runThumbnails(int argc, char *argv[]);
+
+#endif
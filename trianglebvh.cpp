@@ -0,0 +1,499 @@
+/*
+  trianglebvh.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "trianglebvh.h"
+
+// Centroid bins per axis when evaluating splits
+static const int NUM_BINS = 16;
+// Nodes this small become leaves
+static const unsigned int MAX_LEAF_TRIS = 4;
+// Binning a node this large is spread across threads
+static const unsigned int PARALLEL_BIN_MIN = 1<<16;
+
+namespace {
+
+struct Bin {
+    float bmin[3];
+    float bmax[3];
+    unsigned int count;
+
+    void clear() {
+        for (int k=0; k<3; ++k) {
+            bmin[k] = FLT_MAX;
+            bmax[k] = -FLT_MAX;
+        }
+        count = 0;
+    }
+    void grow(const Bin &b) {
+        for (int k=0; k<3; ++k) {
+            bmin[k] = std::min(bmin[k], b.bmin[k]);
+            bmax[k] = std::max(bmax[k], b.bmax[k]);
+        }
+        count += b.count;
+    }
+    float area() const {
+        if (count == 0) {
+            return 0.0f;
+        }
+        float dx = bmax[0]-bmin[0], dy = bmax[1]-bmin[1], dz = bmax[2]-bmin[2];
+        return dx*dy + dy*dz + dz*dx;
+    }
+};
+
+// Which bin a centroid coordinate falls into
+inline int binOf(float c, float cmin, float scale) {
+    int b = int((c - cmin)*scale);
+    return std::min(std::max(b, 0), NUM_BINS-1);
+}
+
+// Entry distance of the ray into the box, or FLT_MAX if it misses or starts beyond max_t
+inline float slabEntry(const TriangleBVH::Node &node, const float origin[3],
+                       const float inv_dir[3], float max_t) {
+    float tmin = 0.0f;
+    float tmax = max_t;
+    for (int k=0; k<3; ++k) {
+        float t0 = (node.bmin[k] - origin[k])*inv_dir[k];
+        float t1 = (node.bmax[k] - origin[k])*inv_dir[k];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        // Written so NaNs from 0*inf leave the interval alone
+        tmin = t0 > tmin ? t0 : tmin;
+        tmax = t1 < tmax ? t1 : tmax;
+    }
+    return tmin <= tmax ? tmin : FLT_MAX;
+}
+
+// Moller-Trumbore, two sided.  Returns the ray parameter or FLT_MAX.
+inline float intersectTriangle(const float *tri, const float origin[3], const float dir[3]) {
+    float e1[3] = {tri[3]-tri[0], tri[4]-tri[1], tri[5]-tri[2]};
+    float e2[3] = {tri[6]-tri[0], tri[7]-tri[1], tri[8]-tri[2]};
+    float p[3] = {dir[1]*e2[2] - dir[2]*e2[1],
+                  dir[2]*e2[0] - dir[0]*e2[2],
+                  dir[0]*e2[1] - dir[1]*e2[0]};
+    float det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+    if (det == 0.0f) {
+        return FLT_MAX;
+    }
+    float inv_det = 1.0f/det;
+    float s[3] = {origin[0]-tri[0], origin[1]-tri[1], origin[2]-tri[2]};
+    float u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*inv_det;
+    if (u < 0.0f || u > 1.0f) {
+        return FLT_MAX;
+    }
+    float q[3] = {s[1]*e1[2] - s[2]*e1[1],
+                  s[2]*e1[0] - s[0]*e1[2],
+                  s[0]*e1[1] - s[1]*e1[0]};
+    float v = (dir[0]*q[0] + dir[1]*q[1] + dir[2]*q[2])*inv_det;
+    if (v < 0.0f || u + v > 1.0f) {
+        return FLT_MAX;
+    }
+    float t = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2])*inv_det;
+    return t > 0.0f ? t : FLT_MAX;
+}
+
+// Adds triangles to bins by centroid along each axis
+void binRange(const float *positions, const float *centroids, const unsigned int *tri_index,
+              long count, const float cmin[3], const float scale[3], Bin bins[3][NUM_BINS]) {
+    for (long i=0; i<count; ++i) {
+        unsigned int tri = tri_index[i];
+        const float *v = positions + 9*size_t(tri);
+        const float *c = centroids + 3*size_t(tri);
+        float tmin[3], tmax[3];
+        for (int k=0; k<3; ++k) {
+            tmin[k] = std::min(v[k], std::min(v[k+3], v[k+6]));
+            tmax[k] = std::max(v[k], std::max(v[k+3], v[k+6]));
+        }
+        for (int axis=0; axis<3; ++axis) {
+            Bin &bin = bins[axis][binOf(c[axis], cmin[axis], scale[axis])];
+            for (int k=0; k<3; ++k) {
+                bin.bmin[k] = std::min(bin.bmin[k], tmin[k]);
+                bin.bmax[k] = std::max(bin.bmax[k], tmax[k]);
+            }
+            ++bin.count;
+        }
+    }
+}
+
+void clearBins(Bin bins[3][NUM_BINS]) {
+    for (int k=0; k<3; ++k) {
+        for (int b=0; b<NUM_BINS; ++b) {
+            bins[k][b].clear();
+        }
+    }
+}
+
+// Bins a large node with each thread filling its own set of bins
+void binRangeParallel(const float *positions, const float *centroids, const unsigned int *tri_index,
+                      long count, const float cmin[3], const float scale[3], Bin bins[3][NUM_BINS]) {
+#pragma omp parallel
+    {
+        Bin local[3][NUM_BINS];
+        clearBins(local);
+        long first = 0;
+        long last = count;
+#ifdef _OPENMP
+        long per_thread = (count + omp_get_num_threads() - 1)/omp_get_num_threads();
+        first = std::min(count, per_thread*omp_get_thread_num());
+        last = std::min(count, first + per_thread);
+#endif
+        binRange(positions, centroids, tri_index + first, last - first, cmin, scale, local);
+#pragma omp critical(bvh_bins)
+        for (int k=0; k<3; ++k) {
+            for (int b=0; b<NUM_BINS; ++b) {
+                bins[k][b].grow(local[k][b]);
+            }
+        }
+    }
+}
+
+// Partition predicate matching the bins a split was chosen from
+struct SplitBelow {
+    const float *centroids;
+    int axis;
+    int split;
+    float cmin;
+    float scale;
+
+    SplitBelow(const float *c, int a, int s, float mn, float sc) :
+        centroids(c), axis(a), split(s), cmin(mn), scale(sc) {}
+    bool operator()(unsigned int tri) const {
+        return binOf(centroids[3*size_t(tri)+axis], cmin, scale) < split;
+    }
+};
+
+// Bounds of the centroids of count triangles
+void centroidBounds(const float *centroids, const unsigned int *tri_index, long count,
+                    float cmin[3], float cmax[3]) {
+    for (int k=0; k<3; ++k) {
+        cmin[k] = FLT_MAX;
+        cmax[k] = -FLT_MAX;
+    }
+    for (long i=0; i<count; ++i) {
+        const float *c = centroids + 3*size_t(tri_index[i]);
+        for (int k=0; k<3; ++k) {
+            cmin[k] = std::min(cmin[k], c[k]);
+            cmax[k] = std::max(cmax[k], c[k]);
+        }
+    }
+}
+
+// Fills a child node and its build task from the merged bins
+void makeChild(const Bin &merged, const float *centroids, const unsigned int *tri_index,
+               unsigned int node, unsigned int begin, unsigned int end,
+               TriangleBVH::Node &child, TriangleBVH::BuildTask &task) {
+    for (int k=0; k<3; ++k) {
+        child.bmin[k] = merged.bmin[k];
+        child.bmax[k] = merged.bmax[k];
+    }
+    child.first = 0;
+    child.count = 0;
+    task.node = node;
+    task.begin = begin;
+    task.end = end;
+    centroidBounds(centroids, tri_index + begin, long(end - begin), task.cmin, task.cmax);
+}
+
+}
+
+/*!
+  Builds the hierarchy.  The top of the tree is split until there are
+  enough independent subtrees to keep every thread busy, then the subtrees
+  are built in parallel into their own arrays and appended.
+*/
+TriangleBVH::TriangleBVH(const float *pos, size_t num_tris) : positions(pos) {
+    if (num_tris == 0) {
+        return;
+    }
+    triIndex.resize(num_tris);
+    centroids.resize(3*num_tris);
+
+    Node root;
+    BuildTask rootTask;
+    for (int k=0; k<3; ++k) {
+        root.bmin[k] = rootTask.cmin[k] = FLT_MAX;
+        root.bmax[k] = rootTask.cmax[k] = -FLT_MAX;
+    }
+#pragma omp parallel
+    {
+        float bmin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+        float bmax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        float cmin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+        float cmax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+#pragma omp for nowait
+        for (long i=0; i<long(num_tris); ++i) {
+            const float *v = positions + 9*i;
+            triIndex[i] = (unsigned int)i;
+            for (int k=0; k<3; ++k) {
+                float c = (v[k] + v[k+3] + v[k+6])*(1.0f/3.0f);
+                centroids[3*i+k] = c;
+                cmin[k] = std::min(cmin[k], c);
+                cmax[k] = std::max(cmax[k], c);
+                bmin[k] = std::min(bmin[k], std::min(v[k], std::min(v[k+3], v[k+6])));
+                bmax[k] = std::max(bmax[k], std::max(v[k], std::max(v[k+3], v[k+6])));
+            }
+        }
+#pragma omp critical(bvh_bounds)
+        for (int k=0; k<3; ++k) {
+            root.bmin[k] = std::min(root.bmin[k], bmin[k]);
+            root.bmax[k] = std::max(root.bmax[k], bmax[k]);
+            rootTask.cmin[k] = std::min(rootTask.cmin[k], cmin[k]);
+            rootTask.cmax[k] = std::max(rootTask.cmax[k], cmax[k]);
+        }
+    }
+    root.first = 0;
+    root.count = 0;
+    rootTask.node = 0;
+    rootTask.begin = 0;
+    rootTask.end = (unsigned int)num_tris;
+    nodes.reserve(2*num_tris/MAX_LEAF_TRIS + 1);
+    nodes.push_back(root);
+
+    int num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+    unsigned int subtree_max = (unsigned int)std::max(size_t(PARALLEL_BIN_MIN),
+                                                      num_tris/(8*size_t(num_threads)));
+
+    std::vector<BuildTask> stack(1, rootTask);
+    std::vector<BuildTask> subtrees;
+    while (!stack.empty()) {
+        BuildTask task = stack.back();
+        stack.pop_back();
+        if (task.end - task.begin <= subtree_max) {
+            subtrees.push_back(task);
+            continue;
+        }
+        BuildTask left, right;
+        if (splitNode(nodes, task, left, right, true)) {
+            stack.push_back(left);
+            stack.push_back(right);
+        }
+    }
+
+    std::vector<std::vector<Node> > trees(subtrees.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long i=0; i<long(subtrees.size()); ++i) {
+        buildSubtree(trees[i], subtrees[i]);
+    }
+
+    // Subtree roots go in the slots reserved by the top levels, the rest
+    // is appended with child links shifted to match
+    for (size_t i=0; i<trees.size(); ++i) {
+        std::vector<Node> &tree = trees[i];
+        unsigned int base = (unsigned int)nodes.size() - 1;
+        for (size_t j=0; j<tree.size(); ++j) {
+            Node node = tree[j];
+            if (node.count == 0) {
+                node.first += base;
+            }
+            if (j == 0) {
+                nodes[subtrees[i].node] = node;
+            } else {
+                nodes.push_back(node);
+            }
+        }
+        std::vector<Node>().swap(tree);
+    }
+    std::vector<float>().swap(centroids);
+}
+
+/*!
+  Builds the nodes under root into tree, with root itself at index 0
+*/
+void TriangleBVH::buildSubtree(std::vector<Node> &tree, const BuildTask &root) {
+    tree.push_back(nodes[root.node]);
+    BuildTask task = root;
+    task.node = 0;
+    std::vector<BuildTask> stack(1, task);
+    while (!stack.empty()) {
+        task = stack.back();
+        stack.pop_back();
+        BuildTask left, right;
+        if (splitNode(tree, task, left, right, false)) {
+            stack.push_back(left);
+            stack.push_back(right);
+        }
+    }
+}
+
+/*!
+  Either makes the task's node a leaf and returns false, or partitions its
+  triangles, appends two children to tree and returns their tasks
+*/
+bool TriangleBVH::splitNode(std::vector<Node> &tree, const BuildTask &task,
+                            BuildTask &left, BuildTask &right, bool parallel) {
+    unsigned int count = task.end - task.begin;
+    unsigned int *tris = &triIndex[task.begin];
+
+    Node &node = tree[task.node];
+    if (count <= MAX_LEAF_TRIS) {
+        node.first = task.begin;
+        node.count = count;
+        return false;
+    }
+
+    float scale[3];
+    for (int k=0; k<3; ++k) {
+        float extent = task.cmax[k] - task.cmin[k];
+        scale[k] = extent > 0.0f ? float(NUM_BINS)/extent : 0.0f;
+    }
+
+    Bin bins[3][NUM_BINS];
+    clearBins(bins);
+    if (parallel && count >= PARALLEL_BIN_MIN) {
+        binRangeParallel(positions, &centroids[0], tris, long(count), task.cmin, scale, bins);
+    } else {
+        binRange(positions, &centroids[0], tris, long(count), task.cmin, scale, bins);
+    }
+
+    // Larger nodes are always split, at the cheapest bin boundary.
+    // The traversal cost is the same for every split, so only the
+    // children's area weighted counts are compared.
+    int best_axis = -1;
+    int best_split = 0;
+    float best_cost = FLT_MAX;
+    for (int axis=0; axis<3; ++axis) {
+        if (scale[axis] == 0.0f) {
+            continue;
+        }
+        // Sweep from the right so each split's right side cost is ready
+        float right_cost[NUM_BINS];
+        Bin acc;
+        acc.clear();
+        for (int b=NUM_BINS-1; b>0; --b) {
+            acc.grow(bins[axis][b]);
+            right_cost[b] = float(acc.count)*acc.area();
+        }
+        acc.clear();
+        for (int b=1; b<NUM_BINS; ++b) {
+            acc.grow(bins[axis][b-1]);
+            float cost = float(acc.count)*acc.area() + right_cost[b];
+            if (acc.count > 0 && acc.count < count && cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    Bin best_left, best_right;
+    best_left.clear();
+    best_right.clear();
+    if (best_axis < 0) {
+        // All centroids coincide, so any split is as good as another
+        unsigned int half = count/2;
+        for (unsigned int i=0; i<count; ++i) {
+            const float *v = positions + 9*size_t(tris[i]);
+            Bin &side = (i < half) ? best_left : best_right;
+            for (int k=0; k<3; ++k) {
+                side.bmin[k] = std::min(side.bmin[k], std::min(v[k], std::min(v[k+3], v[k+6])));
+                side.bmax[k] = std::max(side.bmax[k], std::max(v[k], std::max(v[k+3], v[k+6])));
+            }
+        }
+        best_left.count = half;
+        best_right.count = count - half;
+    } else {
+        std::partition(tris, tris + count, SplitBelow(&centroids[0], best_axis, best_split,
+                                                      task.cmin[best_axis], scale[best_axis]));
+        for (int b=0; b<NUM_BINS; ++b) {
+            (b < best_split ? best_left : best_right).grow(bins[best_axis][b]);
+        }
+    }
+
+    unsigned int left_node = (unsigned int)tree.size();
+    node.first = left_node;
+    node.count = 0;
+    unsigned int mid_index = task.begin + best_left.count;
+    tree.resize(tree.size() + 2);
+    const float *cents = &centroids[0];
+    makeChild(best_left, cents, &triIndex[0], left_node, task.begin, mid_index, tree[left_node], left);
+    makeChild(best_right, cents, &triIndex[0], left_node+1, mid_index, task.end, tree[left_node+1], right);
+    return true;
+}
+
+size_t TriangleBVH::getNumNodes() const {
+    return nodes.size();
+}
+
+bool TriangleBVH::intersect(const float origin[3], const float in_dir[3], BVHHit &hit) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    float len = std::sqrt(in_dir[0]*in_dir[0] + in_dir[1]*in_dir[1] + in_dir[2]*in_dir[2]);
+    if (len == 0.0f) {
+        return false;
+    }
+    float dir[3] = {in_dir[0]/len, in_dir[1]/len, in_dir[2]/len};
+    float inv_dir[3] = {1.0f/dir[0], 1.0f/dir[1], 1.0f/dir[2]};
+
+    float best_t = FLT_MAX;
+    unsigned int best_tri = 0;
+    std::vector<unsigned int> stack;
+    stack.reserve(64);
+    if (slabEntry(nodes[0], origin, inv_dir, best_t) != FLT_MAX) {
+        stack.push_back(0);
+    }
+    while (!stack.empty()) {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+        // Checked again because a closer hit may have been found since it was pushed
+        if (slabEntry(node, origin, inv_dir, best_t) == FLT_MAX) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (unsigned int i=node.first; i<node.first+node.count; ++i) {
+                float t = intersectTriangle(positions + 9*size_t(triIndex[i]), origin, dir);
+                if (t < best_t) {
+                    best_t = t;
+                    best_tri = triIndex[i];
+                }
+            }
+        } else {
+            float tl = slabEntry(nodes[node.first], origin, inv_dir, best_t);
+            float tr = slabEntry(nodes[node.first+1], origin, inv_dir, best_t);
+            // Nearer child goes on top of the stack
+            if (tl <= tr) {
+                if (tr != FLT_MAX) stack.push_back(node.first+1);
+                if (tl != FLT_MAX) stack.push_back(node.first);
+            } else {
+                if (tl != FLT_MAX) stack.push_back(node.first);
+                if (tr != FLT_MAX) stack.push_back(node.first+1);
+            }
+        }
+    }
+    if (best_t == FLT_MAX) {
+        return false;
+    }
+    hit.triangle = best_tri;
+    hit.distance = best_t;
+    for (int k=0; k<3; ++k) {
+        hit.point[k] = origin[k] + best_t*dir[k];
+    }
+    return true;
+}
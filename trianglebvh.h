@@ -0,0 +1,85 @@
+/*
+  trianglebvh.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef TRIANGLE_BVH_HEADER
+#define TRIANGLE_BVH_HEADER
+
+#include <vector>
+#include <cstddef>
+
+/*!
+  Closest triangle along a ray
+*/
+struct BVHHit {
+    size_t triangle;
+    // Distance from the ray origin, in model units
+    float distance;
+    float point[3];
+};
+
+/*!
+  Bounding volume hierarchy over a triangle soup for ray casting.
+  Built top down with binned SAH splits; the first levels bin in parallel
+  and the subtrees below them are built in parallel.
+
+  Only triangle indices are stored, the positions are read from the
+  array given to the constructor, which must outlive the hierarchy.
+*/
+class TriangleBVH {
+public:
+    // positions holds 9 floats per triangle
+    TriangleBVH(const float *positions, size_t num_tris);
+
+    // Finds the nearest triangle hit by the ray, from either side.
+    // dir doesn't need to be normalized.
+    bool intersect(const float origin[3], const float dir[3], BVHHit &hit) const;
+
+    size_t getNumNodes() const;
+
+    struct Node {
+        float bmin[3];
+        float bmax[3];
+        // Leaves: first triangle in triIndex, inner nodes: left child,
+        // with the right child right after it
+        unsigned int first;
+        // Number of triangles, 0 for inner nodes
+        unsigned int count;
+    };
+
+    // Range of triIndex, and the node it becomes
+    struct BuildTask {
+        unsigned int node;
+        unsigned int begin;
+        unsigned int end;
+        float cmin[3];
+        float cmax[3];
+    };
+
+private:
+    bool splitNode(std::vector<Node> &tree, const BuildTask &task,
+                   BuildTask &left, BuildTask &right, bool parallel);
+    void buildSubtree(std::vector<Node> &tree, const BuildTask &root);
+
+    const float *positions;
+    std::vector<Node> nodes;
+    std::vector<unsigned int> triIndex;
+    // Triangle centroids, only kept during the build
+    std::vector<float> centroids;
+};
+
+#endif